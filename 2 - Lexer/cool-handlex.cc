@@ -0,0 +1,358 @@
+/*
+ *  cool-handlex.cc
+ *              A hand-written, direct-coded COOL scanner.
+ *
+ *  It returns exactly what the flex scanner in cool.flex returns: the
+ *  same token codes, cool_yylval payloads, error messages and line
+ *  numbers, quirks included ('|' is white space, a lone '_' is echoed by
+ *  flex's default rule, a run of string characters is copied up to its
+ *  first NUL).  Instead of a DFA it switches on the first byte of each
+ *  token and finishes identifiers, integers, strings and comments in
+ *  tight loops over the whole input, which is read into memory once.
+ *
+ *  Build cool.flex with -DCOOL_HANDLEX to use it for every scanner, or
+ *  pick it per file with cool_lex_file_using().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cool-lex.h"
+
+static inline bool is_digit(unsigned char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool is_letter(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_word_char(unsigned char c)
+{
+	return is_letter(c) || is_digit(c) || c == '_';
+}
+
+static int lex_error(cool_lex_state *state, const char *msg)
+{
+	state->lval.error_msg = (char *) msg;
+	return ERROR;
+}
+
+/* What flex's default rule does with a character no rule matches. */
+static void echo(char c)
+{
+	fwrite(&c, 1, 1, stdout);
+}
+
+/* Read the whole input: the scanner's FILE, or its in-memory text. */
+static bool load_input(cool_lex_state *state)
+{
+	size_t len = 0;
+	size_t cap;
+	char *buf;
+
+	if (state->fin == NULL) {
+		len = state->text_len - state->text_pos;
+		buf = (char *) malloc(len + 1);
+		if (buf == NULL)
+			return false;
+		memcpy(buf, state->text + state->text_pos, len);
+		state->text_pos += len;
+	}
+	else {
+		cap = 1 << 16;
+		buf = (char *) malloc(cap + 1);
+		if (buf == NULL)
+			return false;
+		size_t n;
+		while ((n = fread(buf + len, 1, cap - len, state->fin)) > 0) {
+			len += n;
+			if (len == cap) {
+				char *bigger = (char *) realloc(buf, 2 * cap + 1);
+				if (bigger == NULL) {
+					free(buf);
+					return false;
+				}
+				buf = bigger;
+				cap *= 2;
+			}
+		}
+	}
+	buf[len] = '\0';
+	state->bytes_read += len;
+	state->hand_text = buf;
+	state->hand_len = len;
+	state->hand_pos = 0;
+	return true;
+}
+
+static void release_input(cool_lex_state *state)
+{
+	free(state->hand_text);
+	state->hand_text = NULL;
+	state->hand_len = 0;
+	state->hand_pos = 0;
+	state->hand_loaded = false;
+}
+
+/* Line checkpoints, as note_line() in cool.flex records them. */
+static void note_line(cool_lex_state *state, const char *p, int condition)
+{
+	if (state->checkpoints == NULL)
+		return;
+	cool_line_checkpoint checkpoint;
+	checkpoint.offset = state->input_base + (p - state->hand_text);
+	checkpoint.condition = condition;
+	checkpoint.lineno = state->lineno;
+	checkpoint.token = state->token_count;
+	checkpoint.resumable = (condition != COOL_STRING);
+	state->checkpoints->push_back(checkpoint);
+}
+
+/* A line start passed by a token that is about to be returned: the line
+ * begins after that token, which is not counted yet.
+ */
+static void note_line_after(cool_lex_state *state, const char *p, int condition)
+{
+	note_line(state, p, condition);
+	if (state->checkpoints != NULL)
+		state->checkpoints->back().token++;
+}
+
+/* The rest of a (* ... *) comment from p.  Returns false at end of input
+ * with p at end.
+ */
+static bool skip_block_comment(cool_lex_state *state, char *&p, char *end)
+{
+	char *start = p;
+	int lines = 0;
+	bool closed = cool_skip_block_comment(&p, end, &lines);
+
+	if (!closed) {
+		for (; p < end; p++)
+			if (*p == '\n')
+				lines++;
+	}
+	if (state->checkpoints != NULL) {
+		for (char *nl = start; (nl = (char *) memchr(nl, '\n', p - nl)) != NULL; ) {
+			nl++;
+			state->lineno++;
+			note_line(state, nl, COOL_COMMENT);
+		}
+	}
+	else
+		state->lineno += lines;
+	return closed;
+}
+
+/* The rest of a -- comment from p, newline included. */
+static bool skip_line_comment(cool_lex_state *state, char *&p, char *end)
+{
+	char *nl = (char *) memchr(p, '\n', end - p);
+
+	if (nl == NULL) {
+		p = end;
+		return false;
+	}
+	p = nl + 1;
+	state->lineno++;
+	note_line(state, p, COOL_INITIAL);
+	return true;
+}
+
+/* A string constant, from just after its opening quote. */
+static int scan_string(cool_lex_state *state, char *&p, char *end)
+{
+	state->string_len = 0;
+	for (;;) {
+		if (p == end)
+			return lex_error(state, "EOF in string constant");
+
+		char *run = p;
+		while (p < end && *p != '\\' && *p != '\n' && *p != '"')
+			p++;
+		if (p > run) {
+			/* a lone NUL is an error; a NUL inside a run ends what is
+			 * copied of it */
+			if (*run == '\0' && p - run == 1)
+				return lex_error(state, "String contains null character");
+			if (!cool_append_string(state, run, strnlen(run, p - run)))
+				return lex_error(state, "String constant too long");
+			continue;
+		}
+		if (*p == '"') {
+			p++;
+			state->string_buf[state->string_len] = '\0';
+			state->lval.symbol = cool_intern(COOL_STRTABLE, state->string_buf,
+			                                 state->string_len);
+			return STR_CONST;
+		}
+		if (*p == '\n') {
+			p++;
+			state->lineno++;
+			note_line_after(state, p, COOL_INITIAL);
+			return lex_error(state, "Unterminated string constant");
+		}
+
+		/* a backslash */
+		if (end - p < 2) {
+			echo(*p++);
+			continue;
+		}
+		char c = p[1];
+		p += 2;
+		switch (c) {
+		case 'n':
+			c = '\n';
+			break;
+		case 't':
+			c = '\t';
+			break;
+		case 'b':
+			c = '\b';
+			break;
+		case 'f':
+			c = '\f';
+			break;
+		}
+		if (!cool_append_string(state, &c, 1))
+			return lex_error(state, "String constant too long");
+		if (p[-1] == '\n') {
+			state->lineno++;
+			note_line(state, p, COOL_STRING);
+		}
+	}
+}
+
+static int scan(cool_lex_state *state, char *&p, char *end)
+{
+	for (;;) {
+		if (p == end)
+			return 0;
+
+		unsigned char c = *p;
+		char *start = p;
+		switch (c) {
+		case '\n':
+			p++;
+			state->lineno++;
+			note_line(state, p, COOL_INITIAL);
+			continue;
+		case ' ': case '\f': case '\r': case '\t': case '\v': case '|':
+			p++;
+			continue;
+
+		case '(':
+			if (end - p >= 2 && p[1] == '*') {
+				p += 2;
+				if (!skip_block_comment(state, p, end))
+					return lex_error(state, "EOF in comment");
+				continue;
+			}
+			p++;
+			return c;
+		case '*':
+			if (end - p >= 2 && p[1] == ')') {
+				p += 2;
+				return lex_error(state, "Unmatched *)");
+			}
+			p++;
+			return c;
+		case '-':
+			if (end - p >= 2 && p[1] == '-') {
+				p += 2;
+				if (!skip_line_comment(state, p, end))
+					return lex_error(state, "EOF in comment");
+				continue;
+			}
+			p++;
+			return c;
+		case '<':
+			if (end - p >= 2 && p[1] == '=') {
+				p += 2;
+				return LE;
+			}
+			if (end - p >= 2 && p[1] == '-') {
+				p += 2;
+				return ASSIGN;
+			}
+			p++;
+			return c;
+		case '=':
+			if (end - p >= 2 && p[1] == '>') {
+				p += 2;
+				return DARROW;
+			}
+			p++;
+			return c;
+		case '+': case '/': case '.': case ',': case ';': case ':':
+		case '~': case ')': case '@': case '{': case '}':
+			p++;
+			return c;
+
+		case '"':
+			p++;
+			return scan_string(state, p, end);
+
+		case '_':
+			echo(*p++);
+			continue;
+		}
+
+		/* The input ends with a NUL sentinel, so these loops need no
+		 * bounds check.
+		 */
+		if (is_digit(c)) {
+			while (is_digit(*p))
+				p++;
+			state->lval.symbol = cool_intern(COOL_INTTABLE, start, p - start);
+			return INT_CONST;
+		}
+		if (is_letter(c)) {
+			while (is_word_char(*p))
+				p++;
+			int token = cool_classify_word(start, p - start);
+			if (token == BOOL_CONST)
+				state->lval.boolean = (c == 't');
+			else if (token == TYPEID || token == OBJECTID)
+				state->lval.symbol = cool_intern(COOL_IDTABLE, start, p - start);
+			return token;
+		}
+
+		p++;
+		state->lval.error_msg = (char *) cool_char_string(c);
+		return ERROR;
+	}
+}
+
+int cool_handlex(cool_lex_state *state)
+{
+	if (!state->hand_loaded) {
+		if (!load_input(state))
+			return 0;
+		state->hand_loaded = true;
+
+		/* a scan that starts inside a comment (cool_lex_range) */
+		char *p = state->hand_text;
+		char *end = p + state->hand_len;
+		int condition = state->start_condition;
+		state->start_condition = COOL_INITIAL;
+		if (condition == COOL_COMMENT && !skip_block_comment(state, p, end)) {
+			state->hand_pos = p - state->hand_text;
+			return lex_error(state, "EOF in comment");
+		}
+		if (condition == COOL_INLINE_COMMENT && !skip_line_comment(state, p, end)) {
+			state->hand_pos = p - state->hand_text;
+			return lex_error(state, "EOF in comment");
+		}
+		state->hand_pos = p - state->hand_text;
+	}
+
+	char *p = state->hand_text + state->hand_pos;
+	int token = scan(state, p, state->hand_text + state->hand_len);
+	state->hand_pos = p - state->hand_text;
+	if (token == 0)
+		release_input(state);
+	return token;
+}
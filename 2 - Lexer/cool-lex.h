@@ -0,0 +1,330 @@
+/*
+ *  cool-lex.h
+ *              Reentrant interface to the COOL scanner in cool.flex.
+ *
+ *  cool_yylex() keeps working as before for the single-file drivers.
+ *  Everything it used to keep in globals lives in a cool_lex_state, so
+ *  several files can be scanned at once, one scanner per thread.  The
+ *  only shared data are idtable/inttable/stringtable, which the scanner
+ *  reaches through thread-safe hash indexes (symbol-index.h).
+ */
+#ifndef COOL_LEX_H
+#define COOL_LEX_H
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cool-parse.h>
+
+/* Max size of string constants */
+#define MAX_STR_CONST 1025
+
+/* The string constant limit in effect: MAX_STR_CONST, or the larger
+ * value COOL_MAX_STRING asks for.
+ */
+size_t cool_max_string();
+
+/* Bump whenever a change to the scanners changes the tokens they produce
+ * for some input; token cache entries from other versions are ignored.
+ */
+#define COOL_SCANNER_VERSION 1
+
+/* A token as the parser would see it: the cool_yylex() return value,
+ * curr_lineno after the token, and the cool_yylval payload.  Payloads
+ * never point into scanner buffers, so tokens outlive their scanner.
+ */
+struct cool_token {
+	int kind;
+	int lineno;
+	YYSTYPE value;
+};
+
+/* The scanner's start conditions, as numbered by flex (checked in
+ * cool.flex).
+ */
+enum cool_start_condition {
+	COOL_INITIAL,
+	COOL_STRING,
+	COOL_COMMENT,
+	COOL_INLINE_COMMENT
+};
+
+/* Scanner state at the first byte of a line.  A scan can be restarted
+ * from any resumable checkpoint; only a line that starts inside a string
+ * constant is not, since the string assembled so far is not recorded.
+ */
+struct cool_line_checkpoint {
+	size_t offset;                  /* input offset of the line */
+	int condition;                  /* a cool_start_condition */
+	int lineno;
+	size_t token;                   /* tokens of the scan that precede it */
+	bool resumable;
+};
+
+struct yy_buffer_state;
+
+/* Per-file scanner state, reached from the rules through yyextra. */
+struct cool_lex_state {
+	FILE *fin;                      /* we read from this file */
+	int lineno;
+	YYSTYPE lval;
+
+	/* to assemble string constants: string_fixed, or string_heap once a
+	 * raised string_limit lets a constant outgrow it */
+	char string_fixed[MAX_STR_CONST + 1];
+	char *string_heap;
+	char *string_buf;
+	size_t string_len;
+	size_t string_cap;              /* excluding the terminating NUL */
+	size_t string_limit;
+
+	/* memory-mapped input, see choose_input_mode() */
+	FILE *input_fin;                /* fin whose input mode is chosen */
+	char *mapped_base;              /* file bytes + two NUL sentinels */
+	size_t mapped_span;
+	struct yy_buffer_state *mapped_buffer;
+	struct yy_buffer_state *stream_buffer;
+
+	/* in-memory input (fin == NULL) and line checkpoints */
+	const char *text;
+	size_t text_len;
+	size_t text_pos;
+	size_t input_base;              /* input offset of text[0] */
+	size_t bytes_read;
+	std::vector<cool_line_checkpoint> *checkpoints;
+	size_t token_count;
+	int start_condition;            /* for a scan that starts mid-input */
+
+	/* the hand-written scanner (cool-handlex.cc) and its input */
+	bool hand_scanner;
+	bool hand_loaded;
+	char *hand_text;                /* the whole input, NUL-terminated */
+	size_t hand_len;
+	size_t hand_pos;
+};
+
+/* The two scanners behind this interface: the flex scanner in cool.flex,
+ * and a hand-written direct-coded one in cool-handlex.cc.  They return the
+ * same tokens.  The default is flex; building cool.flex with -DCOOL_HANDLEX
+ * makes it the hand-written one.
+ */
+enum cool_scanner_kind {
+	COOL_FLEX_SCANNER,
+	COOL_HAND_SCANNER
+};
+
+/* The next token of the hand-written scanner, as cool_yylex_r() would
+ * return it for the same state.
+ */
+int cool_handlex(cool_lex_state *state);
+
+/* Shared by both scanners (defined in cool.flex). */
+int cool_classify_word(const char *s, int len);
+const char *cool_char_string(unsigned char c);
+bool cool_skip_block_comment(char **pos, char *end, int *lines);
+
+/* Append n bytes to the string constant being assembled.  Returns false,
+ * appending nothing, if the constant would pass the length limit.
+ */
+bool cool_append_string(cool_lex_state *state, const char *s, size_t n);
+
+/* Scan one file into tokens, ending with the 0 token that cool_yylex()
+ * returns at end of input.  Returns 0, or -1 if it cannot be opened.
+ */
+int cool_lex_file(const char *filename, std::vector<cool_token> &tokens);
+
+/* cool_lex_file() with a given scanner, for comparing the two. */
+int cool_lex_file_using(cool_scanner_kind scanner, const char *filename,
+                        std::vector<cool_token> &tokens);
+
+/*
+ *  Batch tokenization (token-buffer.cc).  A cool_token_buffer holds tokens
+ *  as parallel arrays, so a consumer that only looks at kinds or lines
+ *  does not drag the payloads through the cache.
+ */
+struct cool_token_buffer {
+	std::vector<short> kinds;
+	std::vector<int> linenos;
+	std::vector<YYSTYPE> values;    /* symbol, boolean or error_msg */
+
+	size_t size() const { return kinds.size(); }
+	void push_back(int kind, int lineno, const YYSTYPE &value)
+	{
+		kinds.push_back(kind);
+		linenos.push_back(lineno);
+		values.push_back(value);
+	}
+	cool_token get(size_t i) const
+	{
+		cool_token token = {kinds[i], linenos[i], values[i]};
+		return token;
+	}
+	void append(const cool_token_buffer &other);
+	void swap(cool_token_buffer &other);
+	void clear();
+};
+
+/* Scan one file into a token buffer, ending with the 0 token.  Returns 0,
+ * or -1 if it cannot be opened.
+ */
+int cool_lex_batch(const char *filename, cool_token_buffer &tokens);
+
+/* Scan one file and hand its tokens to emit in chunks of chunk_size; the
+ * last chunk ends with the 0 token and may be shorter.  emit may take the
+ * chunk's contents.  Returns 0, or -1 if the file cannot be opened.
+ */
+int cool_lex_chunks(const char *filename, size_t chunk_size,
+                    const std::function<void(cool_token_buffer &)> &emit);
+
+/* A file scanned on its own thread: chunks are queued as they are made,
+ * so lexing overlaps with whatever consumes them.  At most max_queued
+ * chunks wait in the queue before the scanner blocks.  filename must stay
+ * valid until the pipe is destroyed.
+ */
+class cool_token_pipe {
+public:
+	cool_token_pipe(const char *filename, size_t chunk_size = 4096, size_t max_queued = 16);
+	~cool_token_pipe();
+
+	/* Wait for the next chunk; false once the last one was taken. */
+	bool pop(cool_token_buffer &chunk);
+	/* After pop() returned false: 0, or -1 if the file could not be opened. */
+	int status() const { return result; }
+
+private:
+	void produce(const char *filename, size_t chunk_size);
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<cool_token_buffer> queue;
+	size_t max_queued;
+	bool done;                      /* the scanner has finished */
+	bool closed;                    /* the consumer has gone */
+	int result;
+	std::thread producer;
+};
+
+/* Tokens for cool_yylex(), from a buffer or a pipe.  next() returns the
+ * same kinds, values and line numbers the scanner would, and keeps
+ * returning 0 at end of input.
+ */
+class cool_token_source {
+public:
+	explicit cool_token_source(const cool_token_buffer &tokens)
+		: pipe(NULL), tokens(&tokens), pos(0) {}
+	explicit cool_token_source(cool_token_pipe &pipe)
+		: pipe(&pipe), tokens(&chunk), pos(0) {}
+
+	int next(YYSTYPE &value, int &lineno)
+	{
+		while (pos == tokens->size()) {
+			if (pipe == NULL || !pipe->pop(chunk))
+				return 0;
+			tokens = &chunk;
+			pos = 0;
+		}
+		value = tokens->values[pos];
+		lineno = tokens->linenos[pos];
+		return tokens->kinds[pos++];
+	}
+
+private:
+	cool_token_pipe *pipe;
+	cool_token_buffer chunk;
+	const cool_token_buffer *tokens;
+	size_t pos;
+};
+
+/* Make cool_yylex(), and so the parser, read from source until it is
+ * reset with cool_yylex_from(NULL).
+ */
+void cool_yylex_from(cool_token_source *source);
+
+/* Scan files[i] into tokens[i] on up to `threads' threads.  The result is
+ * the same as calling cool_lex_file on each file in turn.  Returns the
+ * number of files that could not be opened.
+ */
+int cool_lex_files(const std::vector<const char *> &files,
+                   std::vector<std::vector<cool_token> > &tokens, int threads);
+
+/* Scan text[from.offset, len), starting in the state of checkpoint from.
+ * Tokens and the checkpoints of the lines passed are appended; checkpoint
+ * token indices count from the first token of this scan.  The scan stops
+ * at the first new checkpoint for which sync() is true: it is left as the
+ * last checkpoint, tokens after it are dropped, and true is returned.
+ * Otherwise the scan runs to end of input (ending with the 0 token).
+ */
+bool cool_lex_range(const char *text, size_t len, const cool_line_checkpoint &from,
+                    std::vector<cool_token> &tokens,
+                    std::vector<cool_line_checkpoint> &checkpoints,
+                    const std::function<bool(const cool_line_checkpoint &)> &sync);
+
+/* A token stream kept up to date under edits (incremental-lex.cc).  An
+ * edit is relexed from the last resumable checkpoint before it until a
+ * line start after it is reached in the same state as before; tokens
+ * from there on are reused.
+ */
+struct cool_token_splice {
+	size_t first;                   /* index of the first replaced token */
+	size_t removed;                 /* number of old tokens replaced */
+	std::vector<cool_token> inserted;
+	int line_delta;                 /* line shift of the tokens after them */
+};
+
+class cool_incremental_lexer {
+public:
+	void set_text(const char *text, size_t len);
+	cool_token_splice edit(size_t offset, size_t old_len, const char *text, size_t len);
+
+	const std::string &get_text() const { return text; }
+	const std::vector<cool_token> &get_tokens() const { return tokens; }
+	const std::vector<cool_line_checkpoint> &get_checkpoints() const { return checkpoints; }
+
+private:
+	std::string text;
+	std::vector<cool_token> tokens;
+	std::vector<cool_line_checkpoint> checkpoints;  /* [0] is the start of input */
+};
+
+/* Thread-safe insertion into idtable/inttable/stringtable. */
+enum cool_symbol_table {
+	COOL_IDTABLE,
+	COOL_INTTABLE,
+	COOL_STRTABLE
+};
+
+Symbol cool_intern(cool_symbol_table table, char *s, int len);
+
+/*
+ *  Token cache (token-cache.cc).  A cache file holds the token stream of
+ *  one source file, keyed by a 64-bit FNV-1a hash of the source bytes and
+ *  by what else decides the tokens: the scanner version and the string
+ *  constant limit.  Both are part of the file name and are checked again
+ *  against the header on a read.
+ *
+ *      header   "COOLTOK2", source hash, string limit, scanner version,
+ *               symbol count, token count
+ *      symbols  table (id/int/string/error text), length, bytes
+ *      tokens   kind (u16), line (u32), payload (u32)
+ *
+ *  The payload of a TYPEID, OBJECTID, INT_CONST, STR_CONST or ERROR token
+ *  is an index into the symbol section; for BOOL_CONST it is the value.
+ */
+int cool_source_hash(const char *filename, unsigned long long &hash);
+int cool_token_cache_write(const char *path, unsigned long long hash,
+                           const std::vector<cool_token> &tokens);
+int cool_token_cache_read(const char *path, unsigned long long hash,
+                          std::vector<cool_token> &tokens);
+
+/* cool_lex_file() through the cache directory cache_dir: a hit is read
+ * back without running flex, a miss is scanned and then written out.
+ */
+int cool_lex_file_cached(const char *filename, const char *cache_dir,
+                         std::vector<cool_token> &tokens);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ *  incremental-lex.cc
+ *              Relexing of edited COOL text from per-line checkpoints.
+ *
+ *  The scanner records, at every line start, the start condition the line
+ *  begins in and the line number (see cool_line_checkpoint).  COOL
+ *  comments do not nest, so the start condition is the whole scanner
+ *  state between tokens, except inside a string constant.  An edit is
+ *  relexed from the last resumable checkpoint at or before it, and the
+ *  scan stops at the first line start after the edit where the old scan
+ *  was in the same state: from there on the old tokens are still right,
+ *  up to a shift of their line numbers.
+ */
+#include <string.h>
+#include <algorithm>
+#include "cool-lex.h"
+
+static cool_line_checkpoint start_of_input()
+{
+	cool_line_checkpoint start;
+	start.offset = 0;
+	start.condition = 0;            /* INITIAL */
+	start.lineno = 1;
+	start.token = 0;
+	start.resumable = true;
+	return start;
+}
+
+static bool before_offset(const cool_line_checkpoint &checkpoint, size_t offset)
+{
+	return checkpoint.offset < offset;
+}
+
+void cool_incremental_lexer::set_text(const char *s, size_t len)
+{
+	text.assign(s, len);
+	tokens.clear();
+	checkpoints.assign(1, start_of_input());
+	cool_lex_range(text.data(), text.size(), checkpoints[0], tokens, checkpoints, nullptr);
+}
+
+cool_token_splice cool_incremental_lexer::edit(size_t offset, size_t old_len,
+                                               const char *s, size_t len)
+{
+	long delta = (long) len - (long) old_len;
+	size_t edit_end = offset + len;         /* in the new text */
+
+	text.replace(offset, old_len, s, len);
+
+	/* Restart point: the last resumable line start not after the edit.
+	 * Checkpoint 0 is the start of input, so there always is one.
+	 */
+	size_t start = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset,
+	                                [](size_t off, const cool_line_checkpoint &c) {
+	                                	return off < c.offset;
+	                                }) - checkpoints.begin() - 1;
+	while (!checkpoints[start].resumable)
+		start--;
+	const cool_line_checkpoint from = checkpoints[start];
+
+	/* Resynchronize on a line start past the edit that the old scan
+	 * reached in the same start condition.
+	 */
+	const std::vector<cool_line_checkpoint> &old = checkpoints;
+	size_t match = 0;
+	auto sync = [&](const cool_line_checkpoint &c) {
+		if (!c.resumable || c.offset < edit_end)
+			return false;
+		size_t old_offset = c.offset - delta;
+		auto o = std::lower_bound(old.begin() + start, old.end(), old_offset,
+		                          before_offset);
+		if (o == old.end() || o->offset != old_offset || o->condition != c.condition)
+			return false;
+		match = o - old.begin();
+		return true;
+	};
+
+	std::vector<cool_token> relexed;
+	std::vector<cool_line_checkpoint> lines;
+	bool synced = cool_lex_range(text.data(), text.size(), from, relexed, lines, sync);
+
+	cool_token_splice splice;
+	splice.first = from.token;
+	splice.line_delta = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+		lines[i].token += from.token;
+
+	std::vector<cool_line_checkpoint> tail;
+	if (synced) {
+		const cool_line_checkpoint &o = old[match];
+		splice.removed = o.token - from.token;
+		splice.line_delta = lines.back().lineno - o.lineno;
+		long token_delta = (long) relexed.size() - (long) splice.removed;
+		for (size_t i = match + 1; i < old.size(); i++) {
+			cool_line_checkpoint c = old[i];
+			c.offset += delta;
+			c.lineno += splice.line_delta;
+			c.token += token_delta;
+			tail.push_back(c);
+		}
+		for (size_t i = o.token; i < tokens.size(); i++)
+			tokens[i].lineno += splice.line_delta;
+	}
+	else
+		splice.removed = tokens.size() - from.token;
+
+	tokens.erase(tokens.begin() + splice.first, tokens.begin() + splice.first + splice.removed);
+	tokens.insert(tokens.begin() + splice.first, relexed.begin(), relexed.end());
+	splice.inserted.swap(relexed);
+
+	checkpoints.resize(start + 1);
+	checkpoints.insert(checkpoints.end(), lines.begin(), lines.end());
+	checkpoints.insert(checkpoints.end(), tail.begin(), tail.end());
+	return splice;
+}
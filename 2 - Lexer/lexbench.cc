@@ -0,0 +1,605 @@
+/*
+ *  lexbench.cc
+ *              Throughput benchmark for the COOL scanner.
+ *
+ *  lexbench is linked like lexer, with this file in place of lextest.cc:
+ *
+ *      g++ -O2 -o lexbench lexbench.cc cool-lex.cc cool-handlex.cc \
+ *          token-cache.cc token-buffer.cc incremental-lex.cc \
+ *          handle_flags.cc utilities.cc stringtab.cc -lpthread
+ *
+ *  It writes synthetic corpora of a given size to temporary files, scans
+ *  each one with cool_yylex() the way the lexer driver does, and prints
+ *  one JSON object per corpus on stdout:
+ *
+ *      {"corpus": "strings", "bytes": ..., "tokens": ..., "seconds": ...,
+ *       "mb_per_s": ..., "tokens_per_s": ..., "peak_rss_kb": ...}
+ *
+ *  seconds is the best of --runs scans.  peak_rss_kb is the peak resident
+ *  size of the whole process so far, so corpora are best run largest last
+ *  or one per process.
+ *
+ *  The scans never use the token cache, unless --cache is given: then
+ *  each corpus gets two more objects, with "cache": "cold" for the first
+ *  scan through an empty COOL_TOKEN_CACHE directory (a miss, which scans
+ *  and writes the entry) and "cache": "warm" for the best of --runs scans
+ *  replayed from it.
+ *
+ *  usage: lexbench [--size MB] [--runs N] [--label TEXT] [--test FILE]
+ *                  [--cache] [corpus ...]
+ *         lexbench --compare [--fuzz N] [file ...]
+ *         lexbench --incremental [--fuzz N] [file ...]
+ *
+ *  Corpora: comments, strings, keywords, identifiers, test (the file given
+ *  by --test, test.cl by default, repeated up to the size).  Without a
+ *  corpus argument all of them are run.
+ *
+ *  --compare scans each file, and N fuzzed inputs, with both the flex and
+ *  the hand-written scanner (cool-handlex.cc) and reports on stderr the
+ *  first token where they differ.  The exit status is nonzero if any
+ *  input differs.  Both scanners echo a stray '_' to stdout, as flex's
+ *  default rule does.
+ *
+ *  --incremental makes a series of edits to each file, to a few fixed
+ *  inputs (such as the line after an unterminated string) and to N fuzzed
+ *  inputs with cool_incremental_lexer, and after each edit compares its
+ *  tokens and checkpoints with those of a scan of the edited text from
+ *  scratch.  It tests the scanner lexbench is built with: flex, or the
+ *  hand-written one with -DCOOL_HANDLEX.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include "cool-lex.h"
+
+FILE *fin;
+YYSTYPE cool_yylval;
+
+extern int curr_lineno;
+extern char *curr_filename;
+
+extern int cool_yylex();
+
+/*
+ *  Corpus generators.  Each appends roughly `size' bytes of COOL text;
+ *  a fixed seed keeps every corpus the same from run to run.
+ */
+static unsigned next_random(unsigned &seed)
+{
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 16;
+}
+
+/* Long comments full of "(*" openers.  COOL comments do not nest in this
+ * scanner, so each is closed by a single "*)"; the openers are what the
+ * comment skip has to step over.
+ */
+static void gen_comments(std::string &out, size_t size)
+{
+	unsigned seed = 1;
+	while (out.size() < size) {
+		int depth = 1 + next_random(seed) % 64;
+		out += "(*";
+		for (int i = 0; i < depth; i++) {
+			out += " (* nested level ";
+			out += std::to_string(i);
+			out += (i % 4 == 3) ? " *\n" : " **";
+		}
+		out += " *)\nx <- 1;\n-- a line comment with (* and *) in it\n";
+	}
+}
+
+/* Long string constants with escapes and escaped newlines, kept under
+ * MAX_STR_CONST so none of them is an error.
+ */
+static void gen_strings(std::string &out, size_t size)
+{
+	static const char *pieces[] = {
+		"plain text ", "\\n", "\\t", "\\\"quoted\\\"", "\\\\", "\\b", "\\f",
+		"\\q", "\\\n", "0123456789",
+	};
+	unsigned seed = 2;
+	while (out.size() < size) {
+		out += "s <- \"";
+		size_t start = out.size();
+		while (out.size() - start < MAX_STR_CONST / 2)
+			out += pieces[next_random(seed) % (sizeof(pieces) / sizeof(pieces[0]))];
+		out += "\";\n";
+	}
+}
+
+static void gen_keywords(std::string &out, size_t size)
+{
+	static const char *words[] = {
+		"class", "else", "fi", "if", "in", "inherits", "isvoid", "let",
+		"loop", "pool", "then", "while", "case", "esac", "new", "of", "not",
+		"true", "false", "CLASS", "Else", "LeT", "tRUE", "False",
+	};
+	unsigned seed = 3;
+	int column = 0;
+	while (out.size() < size) {
+		out += words[next_random(seed) % (sizeof(words) / sizeof(words[0]))];
+		if (++column == 12) {
+			out += '\n';
+			column = 0;
+		}
+		else
+			out += ' ';
+	}
+}
+
+static void gen_identifiers(std::string &out, size_t size)
+{
+	unsigned seed = 4;
+	while (out.size() < size) {
+		int len = 256 + next_random(seed) % 3840;
+		out += (next_random(seed) & 1) ? 'T' : 'o';
+		for (int i = 1; i < len; i++) {
+			unsigned r = next_random(seed) % 63;
+			out += (r < 26) ? (char) ('a' + r) :
+			       (r < 52) ? (char) ('A' + r - 26) :
+			       (r < 62) ? (char) ('0' + r - 52) : '_';
+		}
+		out += " <- ";
+		out += std::to_string(next_random(seed));
+		out += ";\n";
+	}
+}
+
+static bool gen_test(std::string &out, size_t size, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+	std::string text;
+	char buf[1 << 16];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	if (text.empty())
+		return false;
+	while (out.size() < size)
+		out += text;
+	return true;
+}
+
+/* Fuzz input: COOL fragments, the characters the scanner treats
+ * specially, and random bytes.
+ */
+static void gen_fuzz(std::string &out, unsigned seed)
+{
+	static const char *pieces[] = {
+		"class", "Main", "x", "tRuE", "false", "If", "inherits", "_", "a_1",
+		"007", "(*", "*)", "*", "(", ")", "--", "\n", "\n", "\"", "\\",
+		"\\\n", "\\n", "\\0", "<-", "<=", "=>", "<", "=", "|", " ",
+		"\t", "\r", "\f", "\v", ";", "{", "}", "[", "!", "\x80",
+	};
+	int count = next_random(seed) % 400;
+	for (int i = 0; i < count; i++) {
+		unsigned r = next_random(seed) % 100;
+		if (r < 5)
+			out += (char) next_random(seed);
+		else if (r < 7)
+			out += '\0';
+		else if (r < 8)
+			out.append(MAX_STR_CONST - 8 + next_random(seed) % 16, 'z');
+		else
+			out += pieces[next_random(seed) % (sizeof(pieces) / sizeof(pieces[0]))];
+	}
+}
+
+static bool same_token(const cool_token &a, const cool_token &b)
+{
+	if (a.kind != b.kind || a.lineno != b.lineno)
+		return false;
+	switch (a.kind) {
+	case STR_CONST:
+	case INT_CONST:
+	case TYPEID:
+	case OBJECTID:
+		return a.value.symbol == b.value.symbol;
+	case BOOL_CONST:
+		return a.value.boolean == b.value.boolean;
+	case ERROR:
+		return strcmp(a.value.error_msg, b.value.error_msg) == 0;
+	default:
+		return true;
+	}
+}
+
+/* The index of the first token where a and b differ; the length of both
+ * if they are the same.
+ */
+static size_t first_difference(const std::vector<cool_token> &a,
+                               const std::vector<cool_token> &b)
+{
+	size_t n = a.size() < b.size() ? a.size() : b.size();
+	size_t i = 0;
+	while (i < n && same_token(a[i], b[i]))
+		i++;
+	return i;
+}
+
+/* Scan path with both scanners; returns 0 if they agree. */
+static int compare(const char *name, const char *path)
+{
+	std::vector<cool_token> flex_tokens, hand_tokens;
+	if (cool_lex_file_using(COOL_FLEX_SCANNER, path, flex_tokens) != 0 ||
+	    cool_lex_file_using(COOL_HAND_SCANNER, path, hand_tokens) != 0) {
+		fprintf(stderr, "lexbench: cannot read %s\n", name);
+		return 1;
+	}
+	size_t n = flex_tokens.size() < hand_tokens.size() ? flex_tokens.size()
+	                                                   : hand_tokens.size();
+	size_t i = first_difference(flex_tokens, hand_tokens);
+	if (i == n && flex_tokens.size() == hand_tokens.size())
+		return 0;
+
+	fprintf(stderr, "%s: scanners differ at token %zu", name, i);
+	if (i < n)
+		fprintf(stderr, " (flex: kind %d line %d, hand: kind %d line %d)",
+		        flex_tokens[i].kind, flex_tokens[i].lineno,
+		        hand_tokens[i].kind, hand_tokens[i].lineno);
+	fprintf(stderr, "\n");
+	return 1;
+}
+
+static int compare_all(const std::vector<std::string> &files, int fuzz)
+{
+	int failed = 0;
+	for (size_t i = 0; i < files.size(); i++)
+		failed += compare(files[i].c_str(), files[i].c_str());
+
+	char path[] = "/tmp/lexbench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return failed + 1;
+	close(fd);
+	for (int i = 0; i < fuzz; i++) {
+		std::string text;
+		gen_fuzz(text, i + 1);
+		FILE *f = fopen(path, "wb");
+		if (f == NULL || fwrite(text.data(), 1, text.size(), f) != text.size()) {
+			if (f != NULL)
+				fclose(f);
+			failed++;
+			break;
+		}
+		fclose(f);
+		std::string name = "fuzz input " + std::to_string(i + 1);
+		failed += compare(name.c_str(), path);
+	}
+	unlink(path);
+
+	fprintf(stderr, "lexbench: %zu files, %d fuzz inputs, %d differ\n",
+	        files.size(), fuzz, failed);
+	return failed;
+}
+
+static bool same_checkpoint(const cool_line_checkpoint &a, const cool_line_checkpoint &b)
+{
+	return a.offset == b.offset && a.condition == b.condition && a.lineno == b.lineno &&
+	       a.token == b.token && a.resumable == b.resumable;
+}
+
+/* Apply the edits one after the other to an incremental lexer on text,
+ * checking it against a scan from scratch after each; returns 0 if it
+ * always agrees.  An edit replaces edit.len bytes at edit.offset (both
+ * cut to the text) with edit.text.
+ */
+struct text_edit {
+	size_t offset;
+	size_t len;
+	std::string text;
+};
+
+static int check_edits(const char *name, const std::string &text,
+                       const std::vector<text_edit> &edits)
+{
+	cool_incremental_lexer lexer;
+	lexer.set_text(text.data(), text.size());
+
+	for (size_t e = 0; e < edits.size(); e++) {
+		size_t size = lexer.get_text().size();
+		size_t offset = edits[e].offset < size ? edits[e].offset : size;
+		size_t len = edits[e].len < size - offset ? edits[e].len : size - offset;
+		lexer.edit(offset, len, edits[e].text.data(), edits[e].text.size());
+
+		cool_incremental_lexer scratch;
+		scratch.set_text(lexer.get_text().data(), lexer.get_text().size());
+		const std::vector<cool_token> &a = lexer.get_tokens(), &b = scratch.get_tokens();
+		size_t i = first_difference(a, b);
+		if (i < a.size() || a.size() != b.size()) {
+			fprintf(stderr, "%s: edit %zu: tokens differ at %zu", name, e, i);
+			if (i < a.size() && i < b.size())
+				fprintf(stderr, " (incremental: kind %d line %d, scratch: kind %d line %d)",
+				        a[i].kind, a[i].lineno, b[i].kind, b[i].lineno);
+			fprintf(stderr, "\n");
+			return 1;
+		}
+		const std::vector<cool_line_checkpoint> &c = lexer.get_checkpoints(),
+		                                        &d = scratch.get_checkpoints();
+		for (size_t j = 0; j < c.size() || j < d.size(); j++)
+			if (j == c.size() || j == d.size() || !same_checkpoint(c[j], d[j])) {
+				fprintf(stderr, "%s: edit %zu: checkpoints differ at line start %zu\n",
+				        name, e, j);
+				return 1;
+			}
+	}
+	return 0;
+}
+
+/* A few edits at random places in a text of about `size' bytes, of a
+ * few bytes each way.
+ */
+static std::vector<text_edit> gen_edits(size_t size, unsigned seed)
+{
+	std::vector<text_edit> edits;
+	for (int i = 0; i < 8; i++) {
+		text_edit edit;
+		edit.offset = size > 0 ? next_random(seed) % (size + 1) : 0;
+		edit.len = next_random(seed) % 6;
+		std::string pieces;
+		gen_fuzz(pieces, next_random(seed));
+		edit.text = pieces.substr(0, next_random(seed) % 8);
+		edits.push_back(edit);
+	}
+	return edits;
+}
+
+static int incremental_all(const std::vector<std::string> &files, int fuzz)
+{
+	/* Edits that start a scan on a line whose checkpoint comes from an
+	 * action that also returned a token.
+	 */
+	static const struct {
+		const char *text;
+		size_t offset, len;
+		const char *replacement;
+	} fixed[] = {
+		{"\"abc\nx\n", 5, 1, "y"},
+		{"\"abc\nx\n", 4, 0, "z "},
+		{"\"abc\ny\nz\n", 7, 1, "(*"},
+		{"\"a\\\nb\nc\n", 6, 1, "d"},
+		{"x \"abc\n\"def\ny\n", 12, 1, "w"},
+	};
+	int failed = 0, inputs = 0;
+	for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++, inputs++) {
+		text_edit edit = {fixed[i].offset, fixed[i].len, fixed[i].replacement};
+		std::string name = "fixed input " + std::to_string(i + 1);
+		failed += check_edits(name.c_str(), fixed[i].text, std::vector<text_edit>(1, edit));
+	}
+	for (size_t i = 0; i < files.size(); i++, inputs++) {
+		std::string text;
+		if (!gen_test(text, 1, files[i].c_str())) {
+			fprintf(stderr, "lexbench: cannot read %s\n", files[i].c_str());
+			failed++;
+			continue;
+		}
+		failed += check_edits(files[i].c_str(), text, gen_edits(text.size(), i + 1));
+	}
+	for (int i = 0; i < fuzz; i++, inputs++) {
+		std::string text;
+		gen_fuzz(text, i + 1);
+		std::string name = "fuzz input " + std::to_string(i + 1);
+		failed += check_edits(name.c_str(), text, gen_edits(text.size(), i + 1));
+	}
+
+	fprintf(stderr, "lexbench: %d inputs edited, %d differ\n", inputs, failed);
+	return failed;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/* Scan the file once with cool_yylex(); returns the number of tokens. */
+static long scan(const char *path)
+{
+	fin = fopen(path, "r");
+	if (fin == NULL)
+		return -1;
+	curr_filename = (char *) path;
+	curr_lineno = 1;
+
+	long tokens = 0;
+	while (cool_yylex() != 0)
+		tokens++;
+	fclose(fin);
+	fin = NULL;
+	return tokens;
+}
+
+static void print_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+/* Best of `runs' scans of path, in seconds; tokens gets the count. */
+static double best_scan(const char *path, int runs, long &tokens)
+{
+	double best = 0;
+	for (int i = 0; i < runs; i++) {
+		double start = now();
+		tokens = scan(path);
+		double seconds = now() - start;
+		if (i == 0 || seconds < best)
+			best = seconds;
+	}
+	return best;
+}
+
+static void report(const char *name, const char *label, const char *cache,
+                   size_t bytes, long tokens, double seconds)
+{
+	printf("{\"corpus\": \"%s\", ", name);
+	if (label != NULL) {
+		printf("\"label\": ");
+		print_string(label);
+		printf(", ");
+	}
+	if (cache != NULL)
+		printf("\"cache\": \"%s\", ", cache);
+	printf("\"bytes\": %zu, \"tokens\": %ld, \"seconds\": %.6f, "
+	       "\"mb_per_s\": %.2f, \"tokens_per_s\": %.0f, \"peak_rss_kb\": %ld}\n",
+	       bytes, tokens, seconds, bytes / seconds / 1e6, tokens / seconds,
+	       peak_rss_kb());
+	fflush(stdout);
+}
+
+static void remove_dir(const char *dir)
+{
+	DIR *d = opendir(dir);
+	if (d == NULL)
+		return;
+	while (struct dirent *entry = readdir(d))
+		if (entry->d_name[0] != '.')
+			unlink((std::string(dir) + "/" + entry->d_name).c_str());
+	closedir(d);
+	rmdir(dir);
+}
+
+static int run(const char *name, const std::string &text, int runs, const char *label,
+               bool cache)
+{
+	char path[] = "/tmp/lexbench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, text.data(), text.size()) != (ssize_t) text.size()) {
+		fprintf(stderr, "lexbench: cannot write corpus %s\n", name);
+		return 1;
+	}
+	close(fd);
+
+	long tokens = 0;
+	double best = best_scan(path, runs, tokens);
+	report(name, label, NULL, text.size(), tokens, best);
+
+	int failed = 0;
+	char dir[] = "/tmp/lexcache.XXXXXX";
+	if (cache && mkdtemp(dir) == NULL) {
+		fprintf(stderr, "lexbench: cannot create a cache directory\n");
+		failed = 1;
+	}
+	else if (cache) {
+		setenv("COOL_TOKEN_CACHE", dir, 1);
+		long cold_tokens = 0, warm_tokens = 0;
+		double cold = best_scan(path, 1, cold_tokens);
+		double warm = best_scan(path, runs, warm_tokens);
+		unsetenv("COOL_TOKEN_CACHE");
+		remove_dir(dir);
+
+		report(name, label, "cold", text.size(), cold_tokens, cold);
+		report(name, label, "warm", text.size(), warm_tokens, warm);
+		if (cold_tokens != tokens || warm_tokens != tokens) {
+			fprintf(stderr, "lexbench: %s: the token cache gives %ld tokens, "
+			        "the scanner %ld\n", name, warm_tokens, tokens);
+			failed = 1;
+		}
+	}
+	unlink(path);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = 16 << 20;
+	int runs = 5;
+	const char *label = NULL;
+	const char *test_file = "test.cl";
+	bool compare_mode = false;
+	bool incremental_mode = false;
+	bool cache = false;
+	int fuzz = 0;
+	std::vector<std::string> corpora;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			size = (size_t) (atof(argv[++i]) * (1 << 20));
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+			label = argv[++i];
+		else if (strcmp(argv[i], "--test") == 0 && i + 1 < argc)
+			test_file = argv[++i];
+		else if (strcmp(argv[i], "--cache") == 0)
+			cache = true;
+		else if (strcmp(argv[i], "--compare") == 0)
+			compare_mode = true;
+		else if (strcmp(argv[i], "--incremental") == 0)
+			incremental_mode = true;
+		else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+			fuzz = atoi(argv[++i]);
+		else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [--size MB] [--runs N] [--label TEXT] "
+			        "[--test FILE] [--cache] [corpus ...]\n"
+			        "       %s --compare [--fuzz N] [file ...]\n"
+			        "       %s --incremental [--fuzz N] [file ...]\n",
+			        argv[0], argv[0], argv[0]);
+			return 1;
+		}
+		else
+			corpora.push_back(argv[i]);
+	}
+	if (compare_mode)
+		return compare_all(corpora, fuzz) != 0;
+	if (incremental_mode)
+		return incremental_all(corpora, fuzz) != 0;
+	if (runs < 1)
+		runs = 1;
+	if (corpora.empty())
+		corpora = {"comments", "strings", "keywords", "identifiers", "test"};
+
+	/* measure the scanner, not a replay from the token cache */
+	unsetenv("COOL_TOKEN_CACHE");
+
+	int failed = 0;
+	for (size_t i = 0; i < corpora.size(); i++) {
+		const std::string &name = corpora[i];
+		std::string text;
+		if (name == "comments")
+			gen_comments(text, size);
+		else if (name == "strings")
+			gen_strings(text, size);
+		else if (name == "keywords")
+			gen_keywords(text, size);
+		else if (name == "identifiers")
+			gen_identifiers(text, size);
+		else if (name == "test") {
+			if (!gen_test(text, size, test_file)) {
+				fprintf(stderr, "lexbench: cannot read %s\n", test_file);
+				failed++;
+				continue;
+			}
+		}
+		else {
+			fprintf(stderr, "lexbench: unknown corpus %s\n", name.c_str());
+			failed++;
+			continue;
+		}
+		failed += run(name.c_str(), text, runs, label, cache);
+	}
+	return failed != 0;
+}
@@ -0,0 +1,206 @@
+/*
+ *  symbol-index.h
+ *              Hash index over idtable/inttable/stringtable.
+ *
+ *  StringTable::add_string finds an existing entry by walking the whole
+ *  table, so each interned lexeme costs O(#symbols).  A SymbolIndex sits
+ *  in front of one table: lookups go to an open-addressing hash table
+ *  whose keys are stored contiguously in an arena, and only a new string
+ *  touches the StringTable itself.  New entries are created and linked
+ *  into the table exactly as add_string would do, so lookup_string,
+ *  iteration and Symbol pointer identity (T1 == SELF_TYPE) are unchanged.
+ *
+ *  The index is split into shards by hash, each with its own lock, so
+ *  scanners on different threads intern into one table at once.  Entries
+ *  that other code added with add_string are picked up on the next miss.
+ */
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stringtab.h>
+
+template <class Elem>
+class SymbolIndex {
+public:
+	explicit SymbolIndex(StringTable<Elem> &t) : table(t), indexed(0) {}
+
+	/* Same result as table.add_string(s, len). */
+	Elem *intern(const char *s, int len);
+
+private:
+	enum { SHARD_BITS = 4, SHARD_COUNT = 1 << SHARD_BITS };
+	enum { CHUNK_SIZE = 1 << 16 };
+
+	struct slot {
+		uint64_t hash;
+		const char *key;        /* in the shard's arena */
+		int len;
+		Elem *elem;             /* NULL if the slot is free */
+	};
+
+	struct shard {
+		std::mutex mutex;
+		std::vector<slot> slots;
+		size_t used;
+		std::vector<std::unique_ptr<char[]> > chunks;
+		char *free;
+		size_t free_len;
+
+		shard() : used(0), free(NULL), free_len(0) {}
+		Elem *find(uint64_t hash, const char *s, int len);
+		void insert(uint64_t hash, const char *s, int len, Elem *elem);
+		const char *store(const char *s, int len);
+		void grow();
+	};
+
+	/* tbl and index are protected in StringTable. */
+	struct access : StringTable<Elem> {
+		static List<Elem> *&list(StringTable<Elem> &t) { return t.*(&access::tbl); }
+		static int &count(StringTable<Elem> &t) { return t.*(&access::index); }
+	};
+
+	static uint64_t hash_of(const char *s, int len);
+	shard &shard_of(uint64_t hash) { return shards[hash >> (64 - SHARD_BITS)]; }
+	void absorb();
+
+	StringTable<Elem> &table;
+	std::mutex table_mutex;         /* guards table and indexed */
+	int indexed;                    /* table entries present in the index */
+	shard shards[SHARD_COUNT];
+};
+
+template <class Elem>
+uint64_t SymbolIndex<Elem>::hash_of(const char *s, int len)
+{
+	/* 64-bit FNV-1a, with a final mix so the top bits pick shards well */
+	uint64_t h = 14695981039346656037ULL;
+	for (int i = 0; i < len; i++) {
+		h ^= (unsigned char) s[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 32);
+}
+
+template <class Elem>
+Elem *SymbolIndex<Elem>::shard::find(uint64_t hash, const char *s, int len)
+{
+	if (slots.empty())
+		return NULL;
+	size_t mask = slots.size() - 1;
+	for (size_t i = hash & mask; slots[i].elem != NULL; i = (i + 1) & mask)
+		if (slots[i].hash == hash && slots[i].len == len &&
+		    memcmp(slots[i].key, s, len) == 0)
+			return slots[i].elem;
+	return NULL;
+}
+
+template <class Elem>
+void SymbolIndex<Elem>::shard::insert(uint64_t hash, const char *s, int len, Elem *elem)
+{
+	if (2 * (used + 1) > slots.size())
+		grow();
+	size_t mask = slots.size() - 1;
+	size_t i = hash & mask;
+	while (slots[i].elem != NULL)
+		i = (i + 1) & mask;
+	slots[i].hash = hash;
+	slots[i].key = store(s, len);
+	slots[i].len = len;
+	slots[i].elem = elem;
+	used++;
+}
+
+template <class Elem>
+const char *SymbolIndex<Elem>::shard::store(const char *s, int len)
+{
+	if (len == 0)
+		return "";      /* free may still be NULL */
+	if ((size_t) len > free_len) {
+		size_t size = (len > CHUNK_SIZE) ? len : CHUNK_SIZE;
+		chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+		free = chunks.back().get();
+		free_len = size;
+	}
+	char *key = free;
+	memcpy(key, s, len);
+	free += len;
+	free_len -= len;
+	return key;
+}
+
+template <class Elem>
+void SymbolIndex<Elem>::shard::grow()
+{
+	std::vector<slot> old;
+	old.swap(slots);
+	slots.assign(old.empty() ? 64 : 2 * old.size(), slot());
+	size_t mask = slots.size() - 1;
+	for (size_t j = 0; j < old.size(); j++) {
+		if (old[j].elem == NULL)
+			continue;
+		size_t i = old[j].hash & mask;
+		while (slots[i].elem != NULL)
+			i = (i + 1) & mask;
+		slots[i] = old[j];
+	}
+}
+
+/* Index the entries added to the table behind our back.  StringTable
+ * prepends new entries, so they are the first (count - indexed) ones.
+ * Called with table_mutex held.
+ */
+template <class Elem>
+void SymbolIndex<Elem>::absorb()
+{
+	int count = access::count(table);
+	List<Elem> *l = access::list(table);
+	for (int i = indexed; i < count && l != NULL; i++, l = l->tl()) {
+		Elem *e = l->hd();
+		uint64_t hash = hash_of(e->get_string(), e->get_len());
+		shard &sh = shard_of(hash);
+		std::lock_guard<std::mutex> lock(sh.mutex);
+		sh.insert(hash, e->get_string(), e->get_len(), e);
+	}
+	indexed = count;
+}
+
+template <class Elem>
+Elem *SymbolIndex<Elem>::intern(const char *s, int len)
+{
+	/* add_string stops at a NUL within the first len bytes */
+	const char *nul = (const char *) memchr(s, '\0', len);
+	if (nul != NULL)
+		len = nul - s;
+
+	uint64_t hash = hash_of(s, len);
+	shard &sh = shard_of(hash);
+	{
+		std::lock_guard<std::mutex> lock(sh.mutex);
+		Elem *e = sh.find(hash, s, len);
+		if (e != NULL)
+			return e;
+	}
+
+	/* Miss: lock order is table_mutex, then a shard. */
+	std::lock_guard<std::mutex> table_lock(table_mutex);
+	if (access::count(table) != indexed)
+		absorb();
+	std::lock_guard<std::mutex> lock(sh.mutex);
+	Elem *e = sh.find(hash, s, len);
+	if (e == NULL) {
+		e = new Elem((char *) s, len, access::count(table)++);
+		access::list(table) = new List<Elem>(e, access::list(table));
+		indexed++;
+		sh.insert(hash, s, len, e);
+	}
+	return e;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ *  token-buffer.cc
+ *              Struct-of-arrays token buffers, and scanning a file on a
+ *              thread of its own into a queue of them.
+ */
+#include "cool-lex.h"
+
+void cool_token_buffer::append(const cool_token_buffer &other)
+{
+	kinds.insert(kinds.end(), other.kinds.begin(), other.kinds.end());
+	linenos.insert(linenos.end(), other.linenos.begin(), other.linenos.end());
+	values.insert(values.end(), other.values.begin(), other.values.end());
+}
+
+void cool_token_buffer::swap(cool_token_buffer &other)
+{
+	kinds.swap(other.kinds);
+	linenos.swap(other.linenos);
+	values.swap(other.values);
+}
+
+void cool_token_buffer::clear()
+{
+	kinds.clear();
+	linenos.clear();
+	values.clear();
+}
+
+cool_token_pipe::cool_token_pipe(const char *filename, size_t chunk_size, size_t max_queued)
+	: max_queued(max_queued), done(false), closed(false), result(0)
+{
+	producer = std::thread(&cool_token_pipe::produce, this, filename, chunk_size);
+}
+
+cool_token_pipe::~cool_token_pipe()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	changed.notify_all();
+	producer.join();
+}
+
+void cool_token_pipe::produce(const char *filename, size_t chunk_size)
+{
+	int status = cool_lex_chunks(filename, chunk_size, [&](cool_token_buffer &chunk) {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&]() { return closed || queue.size() < max_queued; });
+		if (closed)
+			return;
+		queue.push_back(cool_token_buffer());
+		queue.back().swap(chunk);
+		changed.notify_all();
+	});
+
+	std::lock_guard<std::mutex> lock(mutex);
+	result = status;
+	done = true;
+	changed.notify_all();
+}
+
+bool cool_token_pipe::pop(cool_token_buffer &chunk)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [&]() { return done || !queue.empty(); });
+	if (queue.empty())
+		return false;
+	chunk.swap(queue.front());
+	queue.pop_front();
+	changed.notify_all();
+	return true;
+}
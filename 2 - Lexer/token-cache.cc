@@ -0,0 +1,287 @@
+/*
+ *  token-cache.cc
+ *              On-disk cache of COOL token streams, keyed by source hash.
+ *
+ *  See cool-lex.h for the file layout.  All integers are written in host
+ *  byte order: a cache is only meant to be read back on the machine (or
+ *  build farm architecture) that wrote it.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include "cool-lex.h"
+
+static const char cache_magic[8] = {'C', 'O', 'O', 'L', 'T', 'O', 'K', '2'};
+
+enum cache_table {
+	CACHE_ID,
+	CACHE_INT,
+	CACHE_STR,
+	CACHE_ERROR
+};
+
+struct cache_header {
+	char magic[8];
+	uint64_t hash;
+	uint64_t string_limit;
+	uint32_t scanner_version;
+	uint32_t symbol_count;
+	uint32_t token_count;
+	uint32_t unused;
+};
+
+struct cache_record {
+	uint16_t kind;
+	uint32_t lineno;
+	uint32_t payload;
+} __attribute__((packed));
+
+/* ERROR tokens carry a char * that must stay valid after the cache
+ * buffer is gone; loaded messages are kept here for the whole run.
+ */
+static std::mutex error_text_mutex;
+static std::set<std::string> error_texts;
+
+static char *keep_error_text(const char *s, size_t len)
+{
+	std::lock_guard<std::mutex> lock(error_text_mutex);
+	return (char *) error_texts.insert(std::string(s, len)).first->c_str();
+}
+
+static bool has_symbol(int kind)
+{
+	return kind == TYPEID || kind == OBJECTID || kind == INT_CONST ||
+	       kind == STR_CONST;
+}
+
+static cache_table table_of(int kind)
+{
+	switch (kind) {
+	case INT_CONST:
+		return CACHE_INT;
+	case STR_CONST:
+		return CACHE_STR;
+	case ERROR:
+		return CACHE_ERROR;
+	default:
+		return CACHE_ID;
+	}
+}
+
+int cool_source_hash(const char *filename, unsigned long long &hash)
+{
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+		return -1;
+
+	/* 64-bit FNV-1a */
+	uint64_t h = 14695981039346656037ULL;
+	unsigned char buf[1 << 16];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		for (size_t i = 0; i < n; i++) {
+			h ^= buf[i];
+			h *= 1099511628211ULL;
+		}
+	fclose(f);
+	hash = h;
+	return 0;
+}
+
+int cool_token_cache_write(const char *path, unsigned long long hash,
+                           const std::vector<cool_token> &tokens)
+{
+	/* Number the distinct symbols and error texts in order of appearance. */
+	std::unordered_map<const void *, uint32_t> index;
+	std::vector<const cool_token *> symbols;
+	std::vector<cache_record> records(tokens.size());
+
+	for (size_t i = 0; i < tokens.size(); i++) {
+		const cool_token &token = tokens[i];
+		records[i].kind = token.kind;
+		records[i].lineno = token.lineno;
+		records[i].payload = 0;
+		if (token.kind == BOOL_CONST) {
+			records[i].payload = token.value.boolean;
+			continue;
+		}
+		if (!has_symbol(token.kind) && token.kind != ERROR)
+			continue;
+
+		const void *key = (token.kind == ERROR) ? (const void *) token.value.error_msg
+		                                        : (const void *) token.value.symbol;
+		auto found = index.find(key);
+		if (found == index.end()) {
+			found = index.insert(std::make_pair(key, (uint32_t) symbols.size())).first;
+			symbols.push_back(&token);
+		}
+		records[i].payload = found->second;
+	}
+
+	/* Write to a temporary name and rename, so readers never see a
+	 * partial cache file.
+	 */
+	std::string tmp = std::string(path) + ".tmp" + std::to_string(getpid());
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL)
+		return -1;
+
+	cache_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.hash = hash;
+	header.string_limit = cool_max_string();
+	header.scanner_version = COOL_SCANNER_VERSION;
+	header.symbol_count = symbols.size();
+	header.token_count = records.size();
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+	for (size_t i = 0; ok && i < symbols.size(); i++) {
+		const cool_token &token = *symbols[i];
+		const char *text;
+		uint32_t len;
+		if (token.kind == ERROR) {
+			text = token.value.error_msg;
+			len = strlen(text);
+		}
+		else {
+			text = token.value.symbol->get_string();
+			len = token.value.symbol->get_len();
+		}
+		uint8_t table = table_of(token.kind);
+		ok = fwrite(&table, 1, 1, f) == 1 && fwrite(&len, sizeof(len), 1, f) == 1 &&
+		     fwrite(text, 1, len, f) == len;
+	}
+	if (ok && !records.empty())
+		ok = fwrite(&records[0], sizeof(cache_record), records.size(), f) == records.size();
+
+	if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path) != 0) {
+		unlink(tmp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+int cool_token_cache_read(const char *path, unsigned long long hash,
+                          std::vector<cool_token> &tokens)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return -1;
+
+	cache_header header;
+	struct stat st;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+	    header.hash != hash || header.string_limit != cool_max_string() ||
+	    header.scanner_version != COOL_SCANNER_VERSION ||
+	    fstat(fileno(f), &st) != 0) {
+		fclose(f);
+		return -1;
+	}
+
+	/* The counts come from the file: before anything is allocated for
+	 * them, the file must be large enough to hold that many symbols (type
+	 * and length, at least) and token records.  What is left over is all
+	 * the symbol text there can be.
+	 */
+	uint64_t body = (uint64_t) st.st_size - sizeof(header);
+	uint64_t fixed = (uint64_t) header.symbol_count * (1 + sizeof(uint32_t)) +
+	                 (uint64_t) header.token_count * sizeof(cache_record);
+	if (fixed > body) {
+		fclose(f);
+		return -1;
+	}
+	uint64_t text_left = body - fixed;
+
+	/* Symbols: re-interned so that tokens carry the same Symbol pointers a
+	 * scan of the source would have produced.
+	 */
+	std::vector<YYSTYPE> values(header.symbol_count);
+	std::string text;
+	for (uint32_t i = 0; i < header.symbol_count; i++) {
+		uint8_t table;
+		uint32_t len;
+		if (fread(&table, 1, 1, f) != 1 || fread(&len, sizeof(len), 1, f) != 1 ||
+		    len > text_left) {
+			fclose(f);
+			return -1;
+		}
+		text_left -= len;
+		text.resize(len);
+		if (len > 0 && fread(&text[0], 1, len, f) != len) {
+			fclose(f);
+			return -1;
+		}
+		switch (table) {
+		case CACHE_ID:
+			values[i].symbol = cool_intern(COOL_IDTABLE, &text[0], len);
+			break;
+		case CACHE_INT:
+			values[i].symbol = cool_intern(COOL_INTTABLE, &text[0], len);
+			break;
+		case CACHE_STR:
+			values[i].symbol = cool_intern(COOL_STRTABLE, &text[0], len);
+			break;
+		default:
+			values[i].error_msg = keep_error_text(text.data(), len);
+			break;
+		}
+	}
+
+	std::vector<cache_record> records(header.token_count);
+	if (records.empty() ||
+	    fread(&records[0], sizeof(cache_record), records.size(), f) != records.size() ||
+	    records.back().kind != 0) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	size_t first = tokens.size();
+	tokens.resize(first + records.size());
+	for (size_t i = 0; i < records.size(); i++) {
+		cool_token &token = tokens[first + i];
+		token.kind = records[i].kind;
+		token.lineno = records[i].lineno;
+		memset(&token.value, 0, sizeof(token.value));
+		if (token.kind == BOOL_CONST)
+			token.value.boolean = records[i].payload != 0;
+		else if ((has_symbol(token.kind) || token.kind == ERROR) &&
+		         records[i].payload < values.size())
+			token.value = values[records[i].payload];
+	}
+	return 0;
+}
+
+int cool_lex_file_cached(const char *filename, const char *cache_dir,
+                         std::vector<cool_token> &tokens)
+{
+	unsigned long long hash;
+	if (cool_source_hash(filename, hash) != 0)
+		return -1;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx-v%d-s%zu.tok", hash, COOL_SCANNER_VERSION,
+	         cool_max_string());
+	std::string path = std::string(cache_dir) + name;
+
+	std::vector<cool_token> cached;
+	if (cool_token_cache_read(path.c_str(), hash, cached) == 0) {
+		tokens.insert(tokens.end(), cached.begin(), cached.end());
+		return 0;
+	}
+
+	size_t first = tokens.size();
+	if (cool_lex_file(filename, tokens) != 0)
+		return -1;
+	std::vector<cool_token> scanned(tokens.begin() + first, tokens.end());
+	cool_token_cache_write(path.c_str(), hash, scanned);
+	return 0;
+}
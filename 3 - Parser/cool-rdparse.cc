@@ -0,0 +1,736 @@
+/*
+ *  cool-rdparse.cc
+ *              A recursive-descent parser for COOL, in place of the LALR
+ *              tables of cool.y.
+ *
+ *  It parses the grammar of cool.y and builds the same trees.  Expressions
+ *  are parsed by precedence climbing over the %left/%right/%nonassoc
+ *  levels of cool.y: the binary operators climb, a prefix operator takes
+ *  an operand of its own precedence, and ASSIGN, NOT and the body of a let
+ *  take a whole expression, which is what the Lowe precedence of the let
+ *  rules comes to.  Lists are built in loops, so only nesting in the input
+ *  takes stack, and that is cut off at YYMAXDEPTH levels with the
+ *  "memory exhausted" error of a Bison parser.
+ *
+ *  Line numbers are set as YYLLOC_DEFAULT would set them: a node gets the
+ *  line of the first token of the rule that builds it.  So a binary
+ *  operation or a dispatch is on the line of its left operand, and every
+ *  branch of a case on the line of the first branch.
+ *
+ *  Errors are recovered from where the error productions of cool.y
+ *  recover, and reported the same way.  Each state of the Bison parser
+ *  that can shift `error' is a try block here, active for as long as the
+ *  state is on the Bison stack; a syntax error throws to the innermost
+ *  one, which skips to the tokens that may follow `error' and goes on with
+ *  the rest of the production.  errstatus follows yyerrstatus, so errors
+ *  within three tokens of a recovery are not reported either.  The
+ *  productions with an error build no tree; the parse has failed anyway.
+ */
+#include <string.h>
+#include "cool-lex.h"
+#include "parse-context.h"
+#include "let-multi.h"
+
+#ifndef YYMAXDEPTH
+#define YYMAXDEPTH 10000
+#endif
+
+#define ADD_ID(s) cool_intern(COOL_IDTABLE, (char *) (s), strlen(s))
+#define ADD_STRING(s) cool_intern(COOL_STRTABLE, (char *) (s), strlen(s))
+
+/* Thrown to the innermost recovery point. */
+struct rd_syntax_error {};
+
+/* Thrown to give up the parse: the yyparse() return value. */
+struct rd_abort {
+	int result;
+};
+
+/* Precedence levels of the binary operators, as in cool.y. */
+enum {
+	PREC_NONE,
+	PREC_COMPARE,                   /* %nonassoc LE '<' '=' */
+	PREC_ADD,                       /* %left '+' '-' */
+	PREC_MUL                        /* %left '*' '/' */
+};
+
+static int binary_precedence(int token)
+{
+	switch (token) {
+	case LE: case '<': case '=':
+		return PREC_COMPARE;
+	case '+': case '-':
+		return PREC_ADD;
+	case '*': case '/':
+		return PREC_MUL;
+	default:
+		return PREC_NONE;
+	}
+}
+
+class rd_parser {
+public:
+	explicit rd_parser(cool_parse_context *ctx) : ctx(ctx), errstatus(0), depth(0) {}
+
+	int parse();
+
+private:
+	cool_parse_context *ctx;
+	int errstatus;                  /* yyerrstatus */
+	int depth;
+
+	/* The line of nodes built next (SET_NODELOC in cool.y). */
+	void at(int line)
+	{
+		*(parse_node_lineno != NULL ? parse_node_lineno : &node_lineno) = line;
+	}
+
+	void yyerrok() { errstatus = 0; }
+
+	/* cool_parse_lex(), with a token source read in line */
+	void advance()
+	{
+		if (ctx->tokens != NULL)
+			ctx->token = ctx->tokens->next(ctx->value, ctx->lineno);
+		else
+			cool_parse_lex(ctx);
+	}
+
+	void shift()
+	{
+		if (errstatus > 0)
+			errstatus--;
+		advance();
+	}
+
+	void error();
+	void skip_to(int sync, int other_sync = -1);
+	void expect(int token);
+	Symbol symbol(int token);
+
+	Class_ class_();
+	Class_ class_body(int line, Symbol name, Symbol parent);
+	Features feature_list();
+	Feature feature();
+	Feature method_tail(int line, Symbol name);
+	Formals formal_list();
+
+	Expression expression(int &line);
+	Expression binary(int min_precedence, int &line);
+	Expression unary(int &line);
+	Expression primary(int &line);
+	Expression postfix(Expression receiver, int line);
+	Expressions arguments();
+	Expression block();
+	Expression let();
+	Expression typcase();
+};
+
+/* yyerrlab and yyerrlab1: report the error unless one was just recovered
+ * from, and go to the innermost state that shifts `error'.
+ */
+void rd_parser::error()
+{
+	if (errstatus == 0)
+		cool_parse_syntax_error(ctx, "syntax error");
+	errstatus = 3;
+	throw rd_syntax_error();
+}
+
+/* After `error' is shifted: discard tokens up to one that may follow it. */
+void rd_parser::skip_to(int sync, int other_sync)
+{
+	while (ctx->token != sync && ctx->token != other_sync) {
+		if (ctx->token == 0)
+			throw rd_abort{1};
+		advance();
+	}
+}
+
+void rd_parser::expect(int token)
+{
+	if (ctx->token != token)
+		error();
+	shift();
+}
+
+Symbol rd_parser::symbol(int token)
+{
+	Symbol s = ctx->value.symbol;
+	expect(token);
+	return s;
+}
+
+int rd_parser::parse()
+{
+	Classes classes = NULL;
+	int line = 0;
+
+	try {
+		advance();
+		line = ctx->lineno;
+		do {
+			if (ctx->token != CLASS)
+				error();
+			Class_ c = class_();
+			if (c != NULL) {
+				classes = classes == NULL ? flat_single(c) : flat_push(classes, c);
+				ctx->classes = classes;
+				cool_parse_class(ctx, c);
+			}
+		} while (ctx->token != 0);
+	} catch (const rd_syntax_error &) {
+		return 1;               /* no state shifts `error' at the top */
+	} catch (const rd_abort &abort) {
+		return abort.result;
+	}
+
+	if (classes == NULL)
+		ctx->classes = classes = flat_nil<Class_>();
+	at(line);
+	ctx->ast_root = program(classes);
+	return 0;
+}
+
+/* class: from CLASS TYPEID on, CLASS TYPEID . error '{' ... recovers. */
+Class_ rd_parser::class_()
+{
+	int line = ctx->lineno;
+	shift();
+	Symbol name = symbol(TYPEID);
+
+	for (bool recovering = false;; ) {
+		try {
+			if (recovering) {
+				shift();
+				feature_list();
+				yyerrok();
+				return NULL;
+			}
+			if (ctx->token != INHERITS) {
+				expect('{');
+				return class_body(line, name, ADD_ID("Object"));
+			}
+			shift();
+			/* CLASS TYPEID INHERITS . error ';' and ... error '{' ... */
+			for (bool inherits_error = false;; ) {
+				try {
+					if (inherits_error) {
+						bool body = ctx->token == '{';
+						shift();
+						if (body)
+							feature_list();
+						yyerrok();
+						return NULL;
+					}
+					Symbol parent = symbol(TYPEID);
+					expect('{');
+					return class_body(line, name, parent);
+				} catch (const rd_syntax_error &) {
+					skip_to(';', '{');
+					inherits_error = true;
+				}
+			}
+		} catch (const rd_syntax_error &) {
+			skip_to('{');
+			recovering = true;
+		}
+	}
+}
+
+Class_ rd_parser::class_body(int line, Symbol name, Symbol parent)
+{
+	Features features = feature_list();
+	at(line);
+	return ::class_(name, parent, features, ADD_STRING(ctx->filename));
+}
+
+/* The features of a class, its '}' and its ';'.  The state after
+ * feature_list shifts `error' for error '(' formal_list ')' ..., and is
+ * on the stack until the class is reduced.
+ */
+Features rd_parser::feature_list()
+{
+	Features features = flat_nil<Feature>();
+
+	for (bool recovering = false;; ) {
+		try {
+			if (recovering) {
+				recovering = false;
+				shift();
+				formal_list();
+				expect(')');
+				expect(':');
+				symbol(TYPEID);
+				expect('{');
+				int line;
+				expression(line);
+				expect('}');
+				expect(';');
+				yyerrok();
+				continue;
+			}
+			if (ctx->token == OBJECTID) {
+				Feature f = feature();
+				if (f != NULL)
+					flat_push(features, f);
+				continue;
+			}
+			expect('}');
+			expect(';');
+			return features;
+		} catch (const rd_syntax_error &) {
+			skip_to('(');
+			recovering = true;
+		}
+	}
+}
+
+Feature rd_parser::feature()
+{
+	int line = ctx->lineno;
+	Symbol name = ctx->value.symbol;
+	shift();
+
+	if (ctx->token == '(') {
+		shift();
+		return method_tail(line, name);
+	}
+	expect(':');
+
+	/* OBJECTID ':' . error ';' */
+	for (bool recovering = false;; ) {
+		try {
+			if (recovering) {
+				shift();
+				yyerrok();
+				return NULL;
+			}
+			Symbol type = symbol(TYPEID);
+			Expression init;
+			if (ctx->token == ASSIGN) {
+				shift();
+				int init_line;
+				init = expression(init_line);
+				expect(';');
+			} else if (ctx->token == ';') {
+				shift();
+				at(line);
+				init = no_expr();
+			} else {
+				/* OBJECTID ':' TYPEID, reduced on any lookahead */
+				yyerrok();
+				at(line);
+				init = no_expr();
+			}
+			at(line);
+			return attr(name, type, init);
+		} catch (const rd_syntax_error &) {
+			skip_to(';');
+			recovering = true;
+		}
+	}
+}
+
+/* OBJECTID '(' . error ')' ..., on the stack until the method is reduced,
+ * and within it OBJECTID '(' formal_list ')' ':' TYPEID '{' . error '}' ';'.
+ */
+Feature rd_parser::method_tail(int line, Symbol name)
+{
+	for (bool recovering = false;; ) {
+		try {
+			if (recovering) {
+				shift();
+				expect(':');
+				symbol(TYPEID);
+				expect('{');
+				int body_line;
+				expression(body_line);
+				expect('}');
+				expect(';');
+				yyerrok();
+				return NULL;
+			}
+			Formals formals = formal_list();
+			expect(')');
+			expect(':');
+			Symbol type = symbol(TYPEID);
+			expect('{');
+			for (bool body_error = false;; ) {
+				try {
+					if (body_error) {
+						shift();
+						expect(';');
+						yyerrok();
+						return NULL;
+					}
+					int body_line;
+					Expression body = expression(body_line);
+					expect('}');
+					expect(';');
+					at(line);
+					return method(name, formals, type, body);
+				} catch (const rd_syntax_error &) {
+					skip_to('}');
+					body_error = true;
+				}
+			}
+		} catch (const rd_syntax_error &) {
+			skip_to(')');
+			recovering = true;
+		}
+	}
+}
+
+Formals rd_parser::formal_list()
+{
+	Formals formals = flat_nil<Formal>();
+	if (ctx->token == ')')
+		return formals;
+
+	for (;;) {
+		int line = ctx->lineno;
+		Symbol name = symbol(OBJECTID);
+		expect(':');
+		Symbol type = symbol(TYPEID);
+		at(line);
+		flat_push(formals, formal(name, type));
+		if (ctx->token != ',')
+			return formals;
+		shift();
+	}
+}
+
+/* A whole expression: what ASSIGN, NOT, let and the bracketing tokens
+ * take.  line is set to the line of its first token, its location.
+ */
+Expression rd_parser::expression(int &line)
+{
+	return binary(PREC_COMPARE, line);
+}
+
+/* Precedence climbing: operators of at least min_precedence, left
+ * associative, with LE '<' '=' not associating at all.
+ */
+Expression rd_parser::binary(int min_precedence, int &line)
+{
+	Expression left = unary(line);
+	bool compared = false;
+
+	for (;;) {
+		int op = ctx->token;
+		int precedence = binary_precedence(op);
+		if (precedence < min_precedence)
+			return left;
+		if (precedence == PREC_COMPARE && compared)
+			error();
+		shift();
+
+		int right_line;
+		Expression right = binary(precedence + 1, right_line);
+		at(line);
+		switch (op) {
+		case '+': left = plus(left, right); break;
+		case '-': left = sub(left, right); break;
+		case '*': left = mul(left, right); break;
+		case '/': left = divide(left, right); break;
+		case '<': left = lt(left, right); break;
+		case LE: left = leq(left, right); break;
+		case '=': left = eq(left, right); break;
+		}
+		compared = precedence == PREC_COMPARE;
+	}
+}
+
+/* ISVOID and '~' bind tighter than every binary operator; NOT takes a
+ * whole expression, since all of them bind tighter than it.  Every level
+ * of nesting comes through here, so the depth is counted here.
+ */
+Expression rd_parser::unary(int &line)
+{
+	struct nesting {
+		int &depth;
+		nesting(int &depth) : depth(depth) { depth++; }
+		~nesting() { depth--; }
+	} nested(depth);
+
+	if (depth > YYMAXDEPTH) {
+		cool_parse_syntax_error(ctx, "memory exhausted");
+		throw rd_abort{2};
+	}
+
+	line = ctx->lineno;
+	int op = ctx->token;
+	int operand_line;
+	Expression operand;
+
+	switch (op) {
+	case ISVOID:
+		shift();
+		operand = unary(operand_line);
+		at(line);
+		return isvoid(operand);
+	case '~':
+		shift();
+		operand = unary(operand_line);
+		at(line);
+		return neg(operand);
+	case NOT:
+		shift();
+		operand = expression(operand_line);
+		at(line);
+		return comp(operand);
+	default:
+		operand = primary(line);
+		return postfix(operand, line);
+	}
+}
+
+Expression rd_parser::primary(int &line)
+{
+	line = ctx->lineno;
+	Symbol s = ctx->value.symbol;
+	int inner_line;
+
+	switch (ctx->token) {
+	case OBJECTID:
+		shift();
+		if (ctx->token == ASSIGN) {
+			shift();
+			Expression value = expression(inner_line);
+			at(line);
+			return assign(s, value);
+		}
+		if (ctx->token == '(') {
+			shift();
+			Expressions args = arguments();
+			at(line);
+			return dispatch(object(ADD_ID("self")), s, args);
+		}
+		at(line);
+		return object(s);
+	case INT_CONST:
+		shift();
+		at(line);
+		return int_const(s);
+	case STR_CONST:
+		shift();
+		at(line);
+		return string_const(s);
+	case BOOL_CONST: {
+		Boolean b = ctx->value.boolean;
+		shift();
+		at(line);
+		return bool_const(b);
+	}
+	case NEW:
+		shift();
+		s = symbol(TYPEID);
+		at(line);
+		return new_(s);
+	case IF: {
+		shift();
+		Expression pred = expression(inner_line);
+		expect(THEN);
+		Expression then_exp = expression(inner_line);
+		expect(ELSE);
+		Expression else_exp = expression(inner_line);
+		expect(FI);
+		at(line);
+		return cond(pred, then_exp, else_exp);
+	}
+	case WHILE: {
+		shift();
+		Expression pred = expression(inner_line);
+		expect(LOOP);
+		Expression body = expression(inner_line);
+		expect(POOL);
+		at(line);
+		return loop(pred, body);
+	}
+	case '(': {
+		shift();
+		Expression e = expression(inner_line);
+		expect(')');
+		return e;
+	}
+	case '{':
+		return block();
+	case LET:
+		return let();
+	case CASE:
+		return typcase();
+	default:
+		error();
+		return NULL;
+	}
+}
+
+/* '.' and '@' bind tightest of all, to the expression just before them. */
+Expression rd_parser::postfix(Expression receiver, int line)
+{
+	for (;;) {
+		if (ctx->token == '.') {
+			shift();
+			Symbol name = symbol(OBJECTID);
+			expect('(');
+			Expressions args = arguments();
+			at(line);
+			receiver = dispatch(receiver, name, args);
+		} else if (ctx->token == '@') {
+			shift();
+			Symbol type = symbol(TYPEID);
+			expect('.');
+			Symbol name = symbol(OBJECTID);
+			expect('(');
+			Expressions args = arguments();
+			at(line);
+			receiver = static_dispatch(receiver, type, name, args);
+		} else {
+			return receiver;
+		}
+	}
+}
+
+/* The arguments of a dispatch and its ')'. */
+Expressions rd_parser::arguments()
+{
+	Expressions args = flat_nil<Expression>();
+	int line;
+
+	if (ctx->token != ')') {
+		flat_push(args, expression(line));
+		while (ctx->token == ',') {
+			shift();
+			flat_push(args, expression(line));
+		}
+	}
+	expect(')');
+	return args;
+}
+
+/* '{' . expression_list_multi and expression_list_multi . error ';' */
+Expression rd_parser::block()
+{
+	int line = ctx->lineno;
+	Expressions body = NULL;
+	shift();
+
+	for (bool recovering = false;; ) {
+		try {
+			if (recovering) {
+				recovering = false;
+				shift();
+				if (body == NULL)
+					body = flat_nil<Expression>();
+				yyerrok();
+				continue;
+			}
+			if (body != NULL && ctx->token == '}') {
+				shift();
+				at(line);
+				return ::block(body);
+			}
+			int e_line;
+			Expression e = expression(e_line);
+			expect(';');
+			body = body == NULL ? flat_single(e) : flat_push(body, e);
+		} catch (const rd_syntax_error &) {
+			skip_to(';');
+			recovering = true;
+		}
+	}
+}
+
+/* LET . let_expression and let_binding_list ',' . error ',' shift `error'
+ * for error ','.  One of them is on the stack up to the end of the let
+ * body, and they all recover alike.  The bindings go into one let_multi
+ * as they are parsed, each on the line of its name.
+ */
+Expression rd_parser::let()
+{
+	Expression l = NULL;
+	int line;
+
+	shift();
+	try {
+		for (;;) {
+			int name_line = ctx->lineno;
+			Symbol name = symbol(OBJECTID);
+			expect(':');
+			Symbol type = symbol(TYPEID);
+			Expression init;
+			if (ctx->token == ASSIGN) {
+				shift();
+				init = expression(line);
+			} else {
+				at(name_line);
+				init = no_expr();
+			}
+			if (l == NULL) {
+				at(name_line);
+				l = let_multi(name_line, name, type, init);
+			} else
+				let_multi_push(l, name_line, name, type, init);
+			if (ctx->token != ',') {
+				expect(IN);
+				return let_multi_body(l, expression(line));
+			}
+			shift();
+		}
+	} catch (const rd_syntax_error &) {
+		skip_to(',');
+		shift();
+		yyerrok();
+		return no_expr();
+	}
+}
+
+/* CASE . error OF case_list ESAC, on the stack until ESAC. */
+Expression rd_parser::typcase()
+{
+	int line = ctx->lineno;
+	Expression subject = NULL;
+	shift();
+
+	for (bool recovering = false;; ) {
+		try {
+			int e_line;
+			if (!recovering)
+				subject = expression(e_line);
+			expect(OF);
+
+			/* case_list OBJECTID ... is on the line of case_list, so every
+			 * branch is on the line of the first one. */
+			int first_line = ctx->lineno;
+			Cases cases = NULL;
+			do {
+				Symbol name = symbol(OBJECTID);
+				expect(':');
+				Symbol type = symbol(TYPEID);
+				expect(DARROW);
+				Expression e = expression(e_line);
+				expect(';');
+				at(first_line);
+				Case c = branch(name, type, e);
+				cases = cases == NULL ? flat_single(c) : flat_push(cases, c);
+			} while (ctx->token == OBJECTID);
+			expect(ESAC);
+
+			if (recovering) {
+				yyerrok();
+				return no_expr();
+			}
+			at(line);
+			return ::typcase(subject, cases);
+		} catch (const rd_syntax_error &) {
+			skip_to(OF);
+			recovering = true;
+		}
+	}
+}
+
+int cool_rdparse(cool_parse_context *ctx)
+{
+	return rd_parser(ctx).parse();
+}
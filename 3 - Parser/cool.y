@@ -6,6 +6,7 @@
 %{
   #include <iostream>
   #include "cool-tree.h"
+  #include "let-multi.h"
   #include "stringtab.h"
   #include "utilities.h"
   
@@ -28,6 +29,15 @@
   }
   #pragma pop_macro("yylex")
 
+  /* Symbols made by the actions go through the scanner's thread-safe
+   * interning (cool-lex.h), since with a cool_token_pipe the scanner may
+   * still be adding to the same tables on another thread.
+   */
+  enum cool_symbol_table { COOL_IDTABLE, COOL_INTTABLE, COOL_STRTABLE };
+  Symbol cool_intern(cool_symbol_table table, char *s, int len);
+  #define ADD_ID(s) cool_intern(COOL_IDTABLE, (char *) (s), strlen(s))
+  #define ADD_STRING(s) cool_intern(COOL_STRTABLE, (char *) (s), strlen(s))
+
   
   /* Locations */
   #define YYLTYPE int              /* the type of locations */
@@ -41,11 +51,32 @@
       
       #define YYLLOC_DEFAULT(Current, Rhs, N)         \
       Current = Rhs[1];                             \
-      node_lineno = Current;
+      SET_NODELOC(Current);                         \
+      PROFILE_REDUCTION(Current, N);
     
     
+    /* A parse on a worker thread keeps its node line in its context
+    (see parse_node_lineno in ast-arena.h). */
     #define SET_NODELOC(Current)  \
-    node_lineno = Current;
+    *(parse_node_lineno != NULL ? parse_node_lineno : &node_lineno) = Current;
+    
+    /* Reduction profiling (-DCOOL_PARSE_PROFILE): YYLLOC_DEFAULT runs just
+    before each semantic action, with yyn the rule about to be reduced.  It
+    also runs when an error is recovered from, on *yylsp rather than yyloc;
+    that is not a reduction.  The rule names come from yytname. */
+    #ifdef COOL_PARSE_PROFILE
+    #ifndef YYDEBUG
+    #define YYDEBUG 1
+    #endif
+    #define PROFILE_REDUCTION(Current, N) \
+    if (&(Current) == &yyloc) profile_reduction(ctx, yyn, yyss, yyssp, N)
+    #define PROFILE_EVENT() profile_event(ctx, false)
+    #define PROFILE_SYNTAX_ERROR() profile_event(ctx, true)
+    #else
+    #define PROFILE_REDUCTION(Current, N)
+    #define PROFILE_EVENT()
+    #define PROFILE_SYNTAX_ERROR()
+    #endif
     
     /* IMPORTANT NOTE ON LINE NUMBERS
     *********************************
@@ -91,7 +122,8 @@
     
     
     
-    void yyerror(char *s);        /*  defined below; called for each parse error */
+    struct cool_parse_context;    /*  the state of one parse (parse-context.h) */
+    void yyerror(YYLTYPE *, cool_parse_context *ctx, char *s);  /*  defined below; called for each parse error */
     extern int yylex();           /*  the entry point to the lexer  */
     
     /************************************************************************/
@@ -102,6 +134,12 @@
     int omerrs = 0;               /* number of errors in lexing and parsing */
     %}
     
+    /* A pure parser: each parse has a context of its own, so files can be
+    parsed on several threads at once (parse-files.cc). */
+    %define api.pure full
+    %parse-param {cool_parse_context *ctx}
+    %lex-param {cool_parse_context *ctx}
+    
     /* A union of all the types that can be the result of parsing actions. */
     %union {
       Boolean boolean;
@@ -120,6 +158,46 @@
       char *error_msg;
     }
     
+    %code {
+      #include "parse-context.h"
+      
+      /* A pure parser does not define these; the lexer and
+      print_cool_token() still use them. */
+      YYSTYPE cool_yylval;
+      int curr_lineno;
+      
+      /* The scanner of a parse: its token source, or the classic cool_yylex()
+      and its globals.  The lookahead token is kept for yyerror(). */
+      int cool_parse_lex(cool_parse_context *ctx)
+      {
+        if (ctx->tokens != NULL)
+          ctx->token = cool_parse_next_token(ctx->tokens, ctx->value, ctx->lineno);
+        else {
+          ctx->token = cool_yylex();
+          ctx->value = cool_yylval;
+          ctx->lineno = curr_lineno;
+        }
+        return ctx->token;
+      }
+      
+      #ifdef COOL_PARSE_PROFILE
+      template <class State>
+      static void profile_reduction(cool_parse_context *ctx, int rule,
+        const State *bottom, const State *top, int len);
+      static void profile_event(cool_parse_context *ctx, bool syntax_error);
+      #endif
+      
+      /* yylex() of the pure parser */
+      static int cool_yylex(YYSTYPE *value, int *lineno, cool_parse_context *ctx)
+      {
+        PROFILE_EVENT();
+        cool_parse_lex(ctx);
+        *value = ctx->value;
+        *lineno = ctx->lineno;
+        return ctx->token;
+      }
+    }
+    
     /* 
     Declare the terminals; a few have types for associated lexemes.
     The token ERROR is never used in the parser; thus, it is a parse
@@ -155,14 +233,15 @@
     %type <feature> feature
 
     %type <formal> formal
-    %type <formals> formal_list_helper /* Because there is no comma before the first variable, I used this additional non-terminal to handle the formal list. */
+    %type <formals> formal_list_helper /* Because there is no comma before the first variable, I used this additional non-terminal (a non-empty formal list) to handle the formal list. */
     %type <formals> formal_list
 
     %type <expression> expression
     %type <expressions> expression_list_multi 
     %type <expressions> expression_list_dispatch
-    %type <expressions> expression_list_dispatch_helper /* I used this additional non-terminal to handle the formal list because there is no comma before the first expression in calling a function. */
-    %type <expression> first_let_expression_handler
+    %type <expressions> expression_list_dispatch_helper /* I used this additional non-terminal (a non-empty argument list) to handle the formal list because there is no comma before the first expression in calling a function. */
+    %type <expression> let_binding_list
+    %type <expression> let_expression
 
     %type <cases> case_list
 
@@ -187,7 +266,7 @@
     : class_list
     { 
       @$ = @1; 
-      ast_root = program($1);
+      ctx->ast_root = program($1);
     }
     ;
 
@@ -195,9 +274,15 @@
     class 
     /* If no parent is specified, the class inherits from the Object class. */
     : CLASS TYPEID '{' feature_list '}' ';'
-      { $$ = class_($2, idtable.add_string("Object"), $4, stringtable.add_string(curr_filename)); }
+      {
+        $$ = class_($2, ADD_ID("Object"), $4, ADD_STRING(ctx->filename));
+        cool_parse_class(ctx, $$);
+      }
     | CLASS TYPEID INHERITS TYPEID '{' feature_list '}' ';'
-      { $$ = class_($2, $4, $6, stringtable.add_string(curr_filename)); }
+      {
+        $$ = class_($2, $4, $6, ADD_STRING(ctx->filename));
+        cool_parse_class(ctx, $$);
+      }
     | CLASS TYPEID error '{' feature_list '}' ';'
       { yyerrok;}
     | CLASS TYPEID INHERITS error ';'
@@ -209,16 +294,18 @@
       { yyerrok; }*/
     ;
 
+    /* Lists are built left-recursively into flat lists (flat-list.h), so
+       the Bison stack stays shallow and nth() on the result is O(1). */
     class_list
     : class
       { 
-      $$ = single_Classes($1);
-      parse_results = $$;
+      $$ = flat_single($1);
+      ctx->classes = $$;
       }
-    | class class_list
+    | class_list class
       { 
-        $$ = append_Classes(single_Classes($1), $2); 
-        parse_results = $$;
+        $$ = flat_push($1, $2); 
+        ctx->classes = $$;
       }
     /* If there is an error in the definition of the class, start parsing from the next class. */
     /*| error ';'
@@ -249,9 +336,9 @@
 
     feature_list
     :	
-      { $$ = nil_Features(); }
-    | feature feature_list
-      { $$ = append_Features(single_Features($1), $2); }
+      { $$ = flat_nil<Feature>(); }
+    | feature_list feature
+      { $$ = flat_push($1, $2); }
     /*| error feature_list
       { yyerrok; }*/
     ;
@@ -262,64 +349,77 @@
     ;
 
     formal_list_helper
-    :
-      { $$ = nil_Formals(); }
-    | ',' formal formal_list_helper 
-      { $$ = append_Formals(single_Formals($2), $3); }
+    : formal
+      { $$ = flat_single($1); }
+    | formal_list_helper ',' formal
+      { $$ = flat_push($1, $3); }
     ;
 
     formal_list
     :
-      { $$ = nil_Formals(); }
-    | formal formal_list_helper
-      { $$ = append_Formals(single_Formals($1), $2); }
+      { $$ = flat_nil<Formal>(); }
+    | formal_list_helper
+      { $$ = $1; }
     ;
 
     expression_list_multi
     : expression ';'
-      { $$ = single_Expressions($1); }
-    | expression ';' expression_list_multi
-      { $$ = append_Expressions(single_Expressions($1), $3); }
+      { $$ = flat_single($1); }
+    | expression_list_multi expression ';'
+      { $$ = flat_push($1, $2); }
     | error ';'
-      { yyerrok; }
-    | error ';' expression_list_multi
-      { yyerrok; }
+      { $$ = flat_nil<Expression>(); yyerrok; }
+    | expression_list_multi error ';'
+      { $$ = $1; yyerrok; }
     ;
 
     expression_list_dispatch_helper
-    : 
-      { $$ = nil_Expressions(); }
-    | ',' expression expression_list_dispatch_helper
-      { $$ = append_Expressions(single_Expressions($2), $3); }
+    : expression
+      { $$ = flat_single($1); }
+    | expression_list_dispatch_helper ',' expression
+      { $$ = flat_push($1, $3); }
     ;
 
     expression_list_dispatch
     :
-      { $$ = nil_Expressions(); }
-    | expression expression_list_dispatch_helper
-      { $$ = append_Expressions(single_Expressions($1), $2); }
+      { $$ = flat_nil<Expression>(); }
+    | expression_list_dispatch_helper
+      { $$ = $1; }
     ;
 
-    /* Parsing (let x y in exp) is similar to the parsing of (let x in let y in exp). */
-    first_let_expression_handler
-    : OBJECTID ':' TYPEID IN expression %prec Lowe /* It is necessary to read up to the end of the let's expressions. */
-      { $$ = let($1, $3, no_expr(), $5); }
-    | OBJECTID ':' TYPEID ASSIGN expression IN expression %prec Lowe
-      { $$ = let($1, $3, $5, $7); }
-    | OBJECTID ':' TYPEID ',' first_let_expression_handler               
-      { $$ = let($1, $3, no_expr(), $5); }
-    | OBJECTID ':' TYPEID ASSIGN expression ',' first_let_expression_handler 
-      { $$ = let($1, $3, $5, $7); }
+    /* (let x, y in exp) means (let x in let y in exp), but all the bindings
+       go into one let_multi node (let-multi.h), left-recursively like the
+       lists above.  Each binding keeps the line of its name. */
+    let_binding_list
+    : OBJECTID ':' TYPEID
+      { $$ = let_multi(@1, $1, $3, no_expr()); }
+    | OBJECTID ':' TYPEID ASSIGN expression
+      { $$ = let_multi(@1, $1, $3, $5); }
+    | let_binding_list ',' OBJECTID ':' TYPEID
+      {
+        SET_NODELOC(@3);
+        $$ = let_multi_push($1, @3, $3, $5, no_expr());
+      }
+    | let_binding_list ',' OBJECTID ':' TYPEID ASSIGN expression
+      { $$ = let_multi_push($1, @3, $3, $5, $7); }
+    ;
+
+    /* An error in a binding or the body ends the let at the next ','. */
+    let_expression
+    : let_binding_list IN expression %prec Lowe /* It is necessary to read up to the end of the let's expressions. */
+      { $$ = let_multi_body($1, $3); }
     | error ','
-      { yyerrok; }
+      { $$ = no_expr(); yyerrok; }
+    | let_binding_list ',' error ','
+      { $$ = no_expr(); yyerrok; }
     ;
 
 
     case_list
     : OBJECTID ':' TYPEID DARROW expression ';'
-      { $$ = single_Cases(branch($1, $3, $5)); }
+      { $$ = flat_single(branch($1, $3, $5)); }
     | case_list OBJECTID ':' TYPEID DARROW expression ';'
-      { $$ = append_Cases($1, single_Cases(branch($2, $4, $6))); }
+      { $$ = flat_push($1, branch($2, $4, $6)); }
     ;
 
     expression
@@ -331,14 +431,14 @@
       { $$ = static_dispatch($1, $3, $5, $7); }
     /* Actually, f(x) is the shortened form of the self.f(x). */
     | OBJECTID '(' expression_list_dispatch ')'
-      { $$ = dispatch(object(idtable.add_string("self")), $1, $3); }
+      { $$ = dispatch(object(ADD_ID("self")), $1, $3); }
     | IF expression THEN expression ELSE expression FI
       { $$ = cond($2, $4, $6); }
     | WHILE expression LOOP expression POOL
       { $$ = loop($2, $4); }
     | '{' expression_list_multi '}'
       { $$ = block($2); }
-    | LET first_let_expression_handler
+    | LET let_expression
       { $$ = $2; }
     | CASE expression OF case_list ESAC
       { $$ = typcase($2, $4); }
@@ -381,17 +481,188 @@
     %%
     
     /* This function is called automatically when Bison detects a parse error. */
-    void yyerror(char *s)
+    void yyerror(YYLTYPE *, cool_parse_context *ctx, char *s)
+    {
+      PROFILE_SYNTAX_ERROR();
+      cool_parse_syntax_error(ctx, s);
+    }
+    
+    void cool_parse_syntax_error(cool_parse_context *ctx, const char *message)
+    {
+      cool_parse_error error = {ctx->lineno, ctx->token, ctx->value, message};
+      
+      ctx->syntax_errors++;
+      
+      if (ctx->deferred)
+        ctx->errors.push_back(error);
+      else
+        cool_report_parse_error(ctx->filename, error);
+    }
+    
+    void cool_report_parse_error(const char *filename, const cool_parse_error &error)
     {
-      extern int curr_lineno;
+      /* print_cool_token() shows the value of the token from cool_yylval */
+      cool_yylval = error.value;
       
-      cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
-      << s << " at or near ";
-      print_cool_token(yychar);
+      cerr << "\"" << filename << "\", line " << error.lineno << ": " \
+      << error.message << " at or near ";
+      print_cool_token(error.token);
       cerr << endl;
       omerrs++;
       
       if(omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
     }
     
-    
\ No newline at end of file
+    int cool_parse_using(cool_parser_kind parser, cool_parse_context *ctx)
+    {
+      if (parser == COOL_RD_PARSER)
+        return cool_rdparse(ctx);
+      return cool_yyparse(ctx);
+    }
+    
+    int cool_parse(cool_parse_context *ctx)
+    {
+#ifdef COOL_RDPARSE
+      return cool_parse_using(COOL_RD_PARSER, ctx);
+#else
+      return cool_parse_using(COOL_BISON_PARSER, ctx);
+#endif
+    }
+    
+    /* The classic entry point: one parse that reads cool_yylex() and sets
+    the globals above. */
+    int cool_yyparse()
+    {
+      cool_parse_context ctx(curr_filename, NULL, false);
+      int result = cool_parse(&ctx);
+      
+      ast_root = ctx.ast_root;
+      parse_results = ctx.classes;
+      return result;
+    }
+    
+    
+    
+#ifdef COOL_PARSE_PROFILE
+    /* The reduction profile: per rule, the number of reductions and the
+    time from the start of its action to the parser's next reduction, token
+    or error, so the action and the goto after it but not the scanner.  The
+    last reduction of a parse is counted but not timed.  Parses on several
+    threads add to the same counters.  At exit the rules are listed on
+    stderr, slowest first, with the deepest parser stack seen and the file
+    it was seen in.  Rules with an error token, the error recovery, are
+    marked with a `*'. */
+    #include <time.h>
+    #include <algorithm>
+    #include <atomic>
+    #include <mutex>
+    #include <string>
+    
+    struct rule_profile {
+      std::atomic<long> reductions;
+      std::atomic<long> nanos;
+      std::once_flag named;
+      std::string text;
+      bool recovery;
+    };
+    
+    static rule_profile rule_profiles[YYNRULES + 1];
+    static std::atomic<long> profile_syntax_errors;
+    static std::mutex peak_mutex;
+    static std::atomic<long> peak_depth;
+    static std::string peak_filename;
+    static int peak_lineno = 0;
+    
+    /* the action being timed on this thread */
+    static thread_local struct {
+      cool_parse_context *ctx;
+      int rule;
+      long start;
+    } profile_open;
+    
+    static long profile_clock()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1000000000L + ts.tv_nsec;
+    }
+    
+    static void profile_close(cool_parse_context *ctx, long now)
+    {
+      if (profile_open.rule != 0 && profile_open.ctx == ctx)
+        rule_profiles[profile_open.rule].nanos += now - profile_open.start;
+      profile_open.rule = 0;
+    }
+    
+    static void profile_event(cool_parse_context *ctx, bool syntax_error)
+    {
+      profile_close(ctx, profile_clock());
+      if (syntax_error)
+        profile_syntax_errors++;
+    }
+    
+    static void profile_report()
+    {
+      std::vector<int> rules;
+      long reductions = 0;
+      for (int r = 0; r <= YYNRULES; r++)
+        if (rule_profiles[r].reductions > 0) {
+          rules.push_back(r);
+          reductions += rule_profiles[r].reductions;
+        }
+      std::stable_sort(rules.begin(), rules.end(), [](int a, int b) {
+        return rule_profiles[a].nanos > rule_profiles[b].nanos;
+      });
+      
+      fprintf(stderr, "parser profile: %ld reductions, %ld syntax errors, "
+        "peak stack depth %ld (%s, line %d)\n", reductions,
+        (long) profile_syntax_errors, (long) peak_depth, peak_filename.c_str(),
+        peak_lineno);
+      fprintf(stderr, "%5s %10s %12s %8s  %s\n", "rule", "reductions",
+        "action_us", "avg_ns", " production");
+      for (size_t i = 0; i < rules.size(); i++) {
+        const rule_profile &p = rule_profiles[rules[i]];
+        fprintf(stderr, "%5d %10ld %12.1f %8ld %c%s\n", rules[i],
+          (long) p.reductions, p.nanos / 1000.0, p.nanos / p.reductions,
+          p.recovery ? '*' : ' ', p.text.c_str());
+      }
+    }
+    
+    /* The states from bottom to top are the parser stack; the symbols that
+    led to the top `len' of them are the right side of the rule. */
+    template <class State>
+    static void profile_reduction(cool_parse_context *ctx, int rule,
+      const State *bottom, const State *top, int len)
+    {
+      static bool reported = (atexit(profile_report), true);
+      rule_profile &p = rule_profiles[rule];
+      long depth = top - bottom + 1;
+      
+      profile_close(ctx, profile_clock());
+      std::call_once(p.named, [&]() {
+        p.text = std::string(yytname[yyr1[rule]]) + ":";
+        p.recovery = false;
+        for (int i = 1 - len; i <= 0; i++) {
+          int symbol = yystos[top[i]];
+          p.text += std::string(" ") + yytname[symbol];
+          p.recovery |= symbol == YYSYMBOL_YYerror;
+        }
+        if (len == 0)
+          p.text += " %empty";
+      });
+      p.reductions++;
+      if (depth > peak_depth) {
+        std::lock_guard<std::mutex> lock(peak_mutex);
+        if (depth > peak_depth) {
+          peak_depth = depth;
+          peak_filename = ctx->filename;
+          peak_lineno = ctx->lineno;
+        }
+      }
+      (void) reported;
+      
+      profile_open.ctx = ctx;
+      profile_open.rule = rule;
+      profile_open.start = profile_clock();
+    }
+#endif
@@ -0,0 +1,109 @@
+/*
+ *  parse-context.h
+ *              The state of one run of the COOL parser.
+ *
+ *  cool.y is a pure parser: apart from the string tables, everything a
+ *  parse reads and writes lives in its cool_parse_context, so several
+ *  files can be parsed at once, one parser per thread (cool_parse_files).
+ *  The classic cool_yyparse() runs one parse on a context that reads
+ *  cool_yylex() and reports through ast_root, parse_results and omerrs.
+ *
+ *  YYSTYPE must be declared before this file is included: the parser gets
+ *  it from bison, everything else from cool-parse.h.
+ */
+#ifndef PARSE_CONTEXT_H
+#define PARSE_CONTEXT_H
+
+#include <functional>
+#include <vector>
+#include "cool-tree.h"
+
+class cool_token_source;
+
+/* A syntax error, with what yyerror() prints of it. */
+struct cool_parse_error {
+	int lineno;                     /* line of the lookahead token */
+	int token;                      /* the lookahead token */
+	YYSTYPE value;
+	const char *message;
+};
+
+struct cool_parse_context {
+	char *filename;
+	cool_token_source *tokens;      /* NULL: read cool_yylex() */
+	bool deferred;                  /* keep errors in `errors' rather than report them */
+
+	int token;                      /* the lookahead token */
+	YYSTYPE value;
+	int lineno;
+	int node_lineno;                /* see parse_node_lineno in ast-arena.h */
+
+	Program ast_root;
+	Classes classes;
+	std::vector<cool_parse_error> errors;
+
+	int syntax_errors;
+
+	/* If set, called with each class as soon as it is parsed, on the
+	 * parser's thread (see semant_stream_class in semant.h), until the
+	 * first syntax error: after that, what the error productions leave
+	 * behind may be in the class. */
+	std::function<void(Class_)> on_class;
+
+	cool_parse_context(char *filename, cool_token_source *tokens, bool deferred)
+		: filename(filename), tokens(tokens), deferred(deferred), token(0),
+		  lineno(0), node_lineno(0), ast_root(NULL), classes(NULL), syntax_errors(0) {}
+};
+
+/* The two parsers behind cool_parse(): the Bison parser of cool.y and a
+ * recursive-descent one in cool-rdparse.cc.  They build the same trees,
+ * with the same line numbers, and report the same errors.  The default is
+ * Bison; building cool.y with -DCOOL_RDPARSE makes it the recursive-descent
+ * one.  All of them return what yyparse() does: 0, 1 if the parse was
+ * abandoned, 2 if it ran out of stack.
+ */
+enum cool_parser_kind {
+	COOL_BISON_PARSER,
+	COOL_RD_PARSER
+};
+
+int cool_parse(cool_parse_context *ctx);
+int cool_parse_using(cool_parser_kind parser, cool_parse_context *ctx);
+int cool_yyparse(cool_parse_context *ctx);
+int cool_rdparse(cool_parse_context *ctx);
+int cool_yyparse();
+
+/* Pass a class the parser has just built to ctx->on_class. */
+inline void cool_parse_class(cool_parse_context *ctx, Class_ c)
+{
+	if (ctx->on_class && ctx->syntax_errors == 0)
+		ctx->on_class(c);
+}
+
+/* Read the next token of a parse into ctx->token, ctx->value and
+ * ctx->lineno, from its token source or from cool_yylex().
+ */
+int cool_parse_lex(cool_parse_context *ctx);
+
+/* A syntax error at the lookahead token of ctx: kept in ctx->errors or
+ * reported at once, as ctx->deferred says.
+ */
+void cool_parse_syntax_error(cool_parse_context *ctx, const char *message);
+
+/* Print an error the way yyerror() always has: on cerr, counted in
+ * omerrs, exiting once there are more than 50.
+ */
+void cool_report_parse_error(const char *filename, const cool_parse_error &error);
+
+/* The next token of a parse that has a token source. */
+int cool_parse_next_token(cool_token_source *tokens, YYSTYPE &value, int &lineno);
+
+/* Lex and parse files on up to `threads' threads, then report their
+ * errors in file order and set ast_root and parse_results to a program of
+ * the classes of all files, in file order.  The output and the error
+ * count are those of parsing the files one after another.  Returns the
+ * number of files that could not be opened.
+ */
+int cool_parse_files(const std::vector<const char *> &files, int threads);
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ *  parse-files.cc
+ *              Parsing many COOL files at once.
+ *
+ *  Each file is lexed into a token buffer and parsed on a worker thread,
+ *  with a context of its own.  Nothing is printed while the workers run:
+ *  the errors of each file are kept and reported afterwards in file
+ *  order, so the messages, omerrs and the 50 error cut-off come out as in
+ *  a sequential run.  Node line numbers go through parse_node_lineno,
+ *  since node_lineno is shared by all threads.
+ */
+#include <atomic>
+#include <thread>
+#include "cool-lex.h"
+#include "parse-context.h"
+
+extern Program ast_root;
+extern Classes parse_results;
+
+int cool_parse_next_token(cool_token_source *tokens, YYSTYPE &value, int &lineno)
+{
+	return tokens->next(value, lineno);
+}
+
+int cool_parse_files(const std::vector<const char *> &files, int threads)
+{
+	std::vector<cool_parse_context> contexts;
+	std::atomic<size_t> next(0);
+	std::atomic<int> failed(0);
+
+	for (size_t i = 0; i < files.size(); i++)
+		contexts.push_back(cool_parse_context((char *) files[i], NULL, true));
+
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next++) < files.size()) {
+			cool_token_buffer tokens;
+			if (cool_lex_batch(files[i], tokens) != 0) {
+				failed++;
+				continue;
+			}
+			cool_token_source source(tokens);
+			cool_parse_context &ctx = contexts[i];
+			ctx.tokens = &source;
+			parse_node_lineno = &ctx.node_lineno;
+			cool_parse(&ctx);
+			parse_node_lineno = NULL;
+			ctx.tokens = NULL;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads && (size_t) t < files.size(); t++)
+		pool.push_back(std::thread(worker));
+	worker();
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+
+	Classes classes = flat_nil<Class_>();
+	for (size_t i = 0; i < contexts.size(); i++) {
+		const cool_parse_context &ctx = contexts[i];
+		for (size_t e = 0; e < ctx.errors.size(); e++)
+			cool_report_parse_error(ctx.filename, ctx.errors[e]);
+		if (ctx.classes == NULL)
+			continue;
+		for (int c = ctx.classes->first(); ctx.classes->more(c); c = ctx.classes->next(c))
+			flat_push(classes, ctx.classes->nth(c));
+	}
+
+	/* the program node is on the line of the first class list */
+	if (!contexts.empty() && contexts[0].ast_root != NULL)
+		node_lineno = contexts[0].ast_root->get_line_number();
+	parse_results = classes;
+	ast_root = program(classes);
+	return failed;
+}
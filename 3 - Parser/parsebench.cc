@@ -0,0 +1,397 @@
+/*
+ *  parsebench.cc
+ *              The Bison parser against the recursive-descent one
+ *              (cool-rdparse.cc).
+ *
+ *  parsebench is linked like parser, with this file in place of
+ *  parser-phase.cc:
+ *
+ *      g++ -O2 -I"../2 - Lexer" -I"../4 - Semantic Analysis" -o parsebench \
+ *          parsebench.cc cool-parse.cc cool-rdparse.cc parse-files.cc \
+ *          cool-lex.cc cool-handlex.cc token-cache.cc token-buffer.cc \
+ *          incremental-lex.cc ast-arena.cc let-multi.cc cool-tree.cc dumptype.cc \
+ *          tree.cc utilities.cc stringtab.cc handle_flags.cc -lpthread
+ *
+ *  Each input is scanned once into a token buffer and parsed from it by
+ *  both parsers, so only parsing is timed.  One JSON object per input and
+ *  parser goes to stdout:
+ *
+ *      {"input": "synthetic", "parser": "rd", "tokens": ..., "seconds": ...,
+ *       "tokens_per_s": ..., "peak_rss_kb": ...}
+ *
+ *  seconds is the best of --runs parses.  The synthetic input is a valid
+ *  program of about --size MB with deeply nested expressions; files given
+ *  on the command line are run as well.
+ *
+ *  usage: parsebench [--size MB] [--runs N] [file ...]
+ *         parsebench --compare [--fuzz N] [file ...]
+ *
+ *  --compare parses each file, the synthetic program and N fuzzed token
+ *  streams with both parsers and reports on stderr any difference in the
+ *  result, the syntax errors, or the dump_with_types() of the tree, which
+ *  has the line number of every node.  Fuzzed streams are the synthetic
+ *  program with tokens dropped, added or replaced; their trees are not
+ *  compared, as a Bison tree with errors in it holds whatever the error
+ *  productions left on the stack.  The exit status is nonzero if any
+ *  input differs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cool-lex.h"
+#include "parse-context.h"
+
+FILE *fin;
+
+extern char *curr_filename;
+
+static unsigned next_random(unsigned &seed)
+{
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 16;
+}
+
+/*
+ *  A valid program: classes of attributes and methods whose bodies are
+ *  random expressions over every production of the grammar.  Comparisons
+ *  are bracketed, since they do not associate.
+ */
+static void gen_expression(std::string &out, int depth, unsigned &seed)
+{
+	static const char *names[] = {"x", "y", "count", "self", "next"};
+	static const char *types[] = {"Int", "Bool", "Main", "SELF_TYPE"};
+	static const char *ops[] = {" + ", " - ", " * ", " / ", " < ", " <= ", " = "};
+	const char *name = names[next_random(seed) % 5];
+	const char *type = types[next_random(seed) % 4];
+	unsigned k = depth <= 0 ? next_random(seed) % 4 : next_random(seed) % 20;
+
+	switch (k) {
+	case 0: out += name; break;
+	case 1: out += std::to_string(next_random(seed) % 1000); break;
+	case 2: out += "\"a string\""; break;
+	case 3: out += (next_random(seed) & 1) ? "true" : "false"; break;
+	case 4: out += "new "; out += type; break;
+	case 5:
+		out += name;
+		out += " <- ";
+		gen_expression(out, depth - 1, seed);
+		break;
+	case 6:
+	case 7:
+		gen_expression(out, depth - 1, seed);
+		out += k == 6 ? ".f(" : "@Main.f(";
+		gen_expression(out, depth - 1, seed);
+		out += ", ";
+		gen_expression(out, depth - 1, seed);
+		out += ")";
+		break;
+	case 8:
+		out += "g()";
+		break;
+	case 9:
+		out += "if ";
+		gen_expression(out, depth - 1, seed);
+		out += " then\n";
+		gen_expression(out, depth - 1, seed);
+		out += "\nelse ";
+		gen_expression(out, depth - 1, seed);
+		out += " fi";
+		break;
+	case 10:
+		out += "while ";
+		gen_expression(out, depth - 1, seed);
+		out += " loop ";
+		gen_expression(out, depth - 1, seed);
+		out += " pool";
+		break;
+	case 11:
+		out += "{\n";
+		for (int i = 0; i < 3; i++) {
+			gen_expression(out, depth - 1, seed);
+			out += ";\n";
+		}
+		out += "}";
+		break;
+	case 12:
+		out += "let x : Int <- ";
+		gen_expression(out, depth - 1, seed);
+		out += ",\n y : ";
+		out += type;
+		out += " in ";
+		gen_expression(out, depth - 1, seed);
+		break;
+	case 13:
+		out += "case ";
+		gen_expression(out, depth - 1, seed);
+		out += " of\n n : Int => ";
+		gen_expression(out, depth - 1, seed);
+		out += ";\n o : Object => ";
+		gen_expression(out, depth - 1, seed);
+		out += ";\nesac";
+		break;
+	case 14:
+		out += "isvoid ";
+		gen_expression(out, depth - 1, seed);
+		break;
+	case 15:
+		out += "~";
+		gen_expression(out, depth - 1, seed);
+		break;
+	case 16:
+		out += "not ";
+		gen_expression(out, depth - 1, seed);
+		break;
+	default: {
+		int op = next_random(seed) % 7;
+		out += op >= 4 ? "(" : "";
+		gen_expression(out, depth - 1, seed);
+		out += ops[op];
+		gen_expression(out, depth - 1, seed);
+		out += op >= 4 ? ")" : "";
+		break;
+	}
+	}
+}
+
+static void gen_program(std::string &out, size_t size)
+{
+	unsigned seed = 1;
+	for (int c = 0; out.size() < size || c == 0; c++) {
+		out += "class C" + std::to_string(c) + " inherits Main {\n";
+		out += "  count : Int <- 0;\n";
+		for (int f = 0; f < 8; f++) {
+			out += "  m" + std::to_string(f) + "(x : Int, y : Bool) : Int {\n    ";
+			gen_expression(out, 6, seed);
+			out += "\n  };\n";
+		}
+		out += "};\n\n";
+	}
+}
+
+/* The synthetic program with a few tokens dropped, added or replaced. */
+static void gen_fuzz(const cool_token_buffer &tokens, cool_token_buffer &out, unsigned seed)
+{
+	static const int kinds[] = {
+		CLASS, INHERITS, TYPEID, OBJECTID, LET, IN, CASE, OF, ESAC, DARROW,
+		IF, THEN, ELSE, FI, ASSIGN, ERROR, '(', ')', '{', '}', ';', ':',
+		',', '.', '@', '+', '<', '=',
+	};
+	YYSTYPE value;
+	value.symbol = idtable.add_string((char *) "fuzz");
+
+	out = tokens;
+	int changes = 1 + next_random(seed) % 3;
+	for (int i = 0; i < changes; i++) {
+		size_t at = next_random(seed) % (out.size() - 1);
+		int kind = kinds[next_random(seed) % (sizeof(kinds) / sizeof(kinds[0]))];
+		switch (next_random(seed) % 3) {
+		case 0:
+			out.kinds.erase(out.kinds.begin() + at);
+			out.linenos.erase(out.linenos.begin() + at);
+			out.values.erase(out.values.begin() + at);
+			break;
+		case 1:
+			out.kinds.insert(out.kinds.begin() + at, kind);
+			out.linenos.insert(out.linenos.begin() + at, out.linenos[at]);
+			out.values.insert(out.values.begin() + at, value);
+			break;
+		default:
+			out.kinds[at] = kind;
+			out.values[at] = value;
+			break;
+		}
+	}
+}
+
+/* Write text to a temporary file and scan it. */
+static bool lex_text(const std::string &text, cool_token_buffer &tokens)
+{
+	char path[] = "/tmp/parsebench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return false;
+	bool ok = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+	close(fd);
+	ok = ok && cool_lex_batch(path, tokens) == 0;
+	unlink(path);
+	return ok;
+}
+
+struct parse_result {
+	int result;
+	std::vector<cool_parse_error> errors;
+	std::string dump;
+};
+
+static parse_result parse(cool_parser_kind parser, const char *name,
+                          const cool_token_buffer &tokens, bool dump)
+{
+	cool_token_source source(tokens);
+	cool_parse_context ctx((char *) name, &source, true);
+	parse_result r;
+	r.result = cool_parse_using(parser, &ctx);
+	r.errors = ctx.errors;
+	if (dump && r.result == 0 && r.errors.empty()) {
+		std::ostringstream out;
+		ctx.ast_root->dump_with_types(out, 0);
+		r.dump = out.str();
+	}
+	return r;
+}
+
+/* Parse tokens with both parsers; returns 0 if they agree. */
+static int compare(const char *name, const cool_token_buffer &tokens, bool dump)
+{
+	parse_result bison = parse(COOL_BISON_PARSER, name, tokens, dump);
+	parse_result rd = parse(COOL_RD_PARSER, name, tokens, dump);
+	ast_arena_release();
+
+	if (bison.result != rd.result) {
+		fprintf(stderr, "%s: parsers return %d and %d\n", name, bison.result, rd.result);
+		return 1;
+	}
+	size_t n = bison.errors.size() < rd.errors.size() ? bison.errors.size()
+	                                                  : rd.errors.size();
+	for (size_t i = 0; i < n; i++) {
+		const cool_parse_error &a = bison.errors[i], &b = rd.errors[i];
+		if (a.lineno != b.lineno || a.token != b.token || strcmp(a.message, b.message) != 0) {
+			fprintf(stderr, "%s: error %zu differs (bison: token %d line %d, rd: token %d line %d)\n",
+			        name, i, a.token, a.lineno, b.token, b.lineno);
+			return 1;
+		}
+	}
+	if (bison.errors.size() != rd.errors.size()) {
+		fprintf(stderr, "%s: %zu and %zu errors\n", name, bison.errors.size(), rd.errors.size());
+		return 1;
+	}
+	if (bison.dump != rd.dump) {
+		fprintf(stderr, "%s: trees differ\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+static int compare_all(const std::vector<const char *> &files, const cool_token_buffer &synthetic,
+                       int fuzz)
+{
+	int failed = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		cool_token_buffer tokens;
+		if (cool_lex_batch(files[i], tokens) != 0) {
+			fprintf(stderr, "parsebench: cannot read %s\n", files[i]);
+			failed++;
+			continue;
+		}
+		failed += compare(files[i], tokens, true);
+	}
+	failed += compare("synthetic", synthetic, true);
+
+	for (int i = 0; i < fuzz; i++) {
+		cool_token_buffer tokens;
+		gen_fuzz(synthetic, tokens, i + 1);
+		std::string name = "fuzz input " + std::to_string(i + 1);
+		failed += compare(name.c_str(), tokens, false);
+	}
+
+	fprintf(stderr, "parsebench: %zu files, %d fuzz inputs, %d differ\n",
+	        files.size(), fuzz, failed);
+	return failed;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static void run(const char *name, const cool_token_buffer &tokens, int runs)
+{
+	static const struct {
+		cool_parser_kind kind;
+		const char *name;
+	} parsers[] = {{COOL_BISON_PARSER, "bison"}, {COOL_RD_PARSER, "rd"}};
+
+	for (size_t p = 0; p < sizeof(parsers) / sizeof(parsers[0]); p++) {
+		double best = 0;
+		for (int i = 0; i < runs; i++) {
+			cool_token_source source(tokens);
+			cool_parse_context ctx((char *) name, &source, true);
+			double start = now();
+			cool_parse_using(parsers[p].kind, &ctx);
+			double seconds = now() - start;
+			ast_arena_release();
+			if (i == 0 || seconds < best)
+				best = seconds;
+		}
+		printf("{\"input\": \"%s\", \"parser\": \"%s\", \"tokens\": %zu, \"seconds\": %.6f, "
+		       "\"tokens_per_s\": %.0f, \"peak_rss_kb\": %ld}\n",
+		       name, parsers[p].name, tokens.size(), best, tokens.size() / best, peak_rss_kb());
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double size_mb = 4;
+	int runs = 5, fuzz = 0;
+	bool compare_mode = false;
+	std::vector<const char *> files;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			size_mb = atof(argv[++i]);
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+			fuzz = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--compare") == 0)
+			compare_mode = true;
+		else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [--size MB] [--runs N] [file ...]\n"
+			                "       %s --compare [--fuzz N] [file ...]\n", argv[0], argv[0]);
+			return 1;
+		} else
+			files.push_back(argv[i]);
+	}
+	if (runs < 1)
+		runs = 1;
+
+	std::string text;
+	cool_token_buffer synthetic;
+	gen_program(text, compare_mode ? 64 * 1024 : (size_t) (size_mb * 1024 * 1024));
+	curr_filename = (char *) "synthetic";
+	if (!lex_text(text, synthetic)) {
+		fprintf(stderr, "parsebench: cannot write the synthetic program\n");
+		return 1;
+	}
+
+	if (compare_mode)
+		return compare_all(files, synthetic, fuzz) != 0;
+
+	int failed = 0;
+	run("synthetic", synthetic, runs);
+	for (size_t i = 0; i < files.size(); i++) {
+		cool_token_buffer tokens;
+		if (cool_lex_batch(files[i], tokens) != 0) {
+			fprintf(stderr, "parsebench: cannot read %s\n", files[i]);
+			failed++;
+			continue;
+		}
+		run(files[i], tokens, runs);
+	}
+	return failed != 0;
+}
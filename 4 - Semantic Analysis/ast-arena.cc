@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <iostream>
+#include "ast-arena.h"
+
+struct arena_phase
+{
+    const char *name;
+    std::atomic<size_t> nodes;
+    std::atomic<size_t> bytes;
+
+    arena_phase(const char *n) : name(n), nodes(0), bytes(0) {}
+};
+
+static const size_t block_size = 1 << 16;
+static const size_t alignment = alignof(max_align_t);
+
+static std::mutex arena_mutex; // guards blocks and phases
+static std::vector<char *> blocks;
+static std::deque<arena_phase> phases;
+static std::atomic<arena_phase *> current(NULL);
+static std::atomic<unsigned> generation(0);
+
+// Each thread bumps through a block of its own; the blocks of an older
+// generation were freed by ast_arena_release().
+static thread_local char *next_free = NULL;
+static thread_local size_t bytes_left = 0;
+static thread_local unsigned block_generation = 0;
+
+thread_local int *parse_node_lineno = NULL;
+
+static void report_at_exit()
+{
+    ast_arena_report(std::cerr);
+}
+
+// Called with arena_mutex held.
+static void add_phase(const char *name)
+{
+    if (phases.empty() && getenv("COOL_ARENA_STATS") != NULL)
+        atexit(report_at_exit);
+    phases.emplace_back(name);
+    current.store(&phases.back(), std::memory_order_release);
+}
+
+static arena_phase *current_phase()
+{
+    arena_phase *phase = current.load(std::memory_order_acquire);
+    if (phase == NULL)
+    {
+        std::lock_guard<std::mutex> lock(arena_mutex);
+        if (phases.empty())
+            add_phase("parse");
+        phase = current.load(std::memory_order_acquire);
+    }
+    return phase;
+}
+
+static char *new_block(size_t size)
+{
+    char *block = (char *)malloc(size);
+    if (block == NULL)
+        throw std::bad_alloc();
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    blocks.push_back(block);
+    return block;
+}
+
+void *ast_arena_allocate_data(size_t size)
+{
+    size = (size + alignment - 1) & ~(alignment - 1);
+    current_phase()->bytes.fetch_add(size, std::memory_order_relaxed);
+
+    // Allocations larger than a quarter block get a block of their own, so
+    // the rest of the current block is not wasted.
+    if (size > block_size / 4)
+        return new_block(size);
+    unsigned g = generation.load(std::memory_order_relaxed);
+    if (block_generation != g)
+    {
+        bytes_left = 0;
+        block_generation = g;
+    }
+    if (size > bytes_left)
+    {
+        next_free = new_block(block_size);
+        bytes_left = block_size;
+    }
+    void *p = next_free;
+    next_free += size;
+    bytes_left -= size;
+    return p;
+}
+
+void *ast_arena_allocate(size_t size)
+{
+    current_phase()->nodes.fetch_add(1, std::memory_order_relaxed);
+    return ast_arena_allocate_data(size);
+}
+
+void ast_arena_release()
+{
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    for (size_t i = 0; i < blocks.size(); i++)
+        free(blocks[i]);
+    blocks.clear();
+    generation++;
+}
+
+void ast_arena_phase(const char *name)
+{
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    add_phase(name);
+}
+
+void ast_arena_report(std::ostream &stream)
+{
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    size_t nodes = 0, bytes = 0;
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        stream << "AST arena: " << phases[i].name << ": " << phases[i].nodes
+               << " nodes, " << phases[i].bytes << " bytes" << std::endl;
+        nodes += phases[i].nodes;
+        bytes += phases[i].bytes;
+    }
+    stream << "AST arena: total: " << nodes << " nodes, " << bytes << " bytes in "
+           << blocks.size() << " blocks" << std::endl;
+}
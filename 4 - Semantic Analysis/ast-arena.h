@@ -0,0 +1,95 @@
+#ifndef AST_ARENA_H
+#define AST_ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+#include <ostream>
+#include <type_traits>
+
+//
+// AST nodes are allocated from one bump arena per compilation: the phylum
+// classes of cool-tree.h get the operators below through their EXTRAS
+// (see cool-tree.handcode.h).  Nodes are never freed one at a time;
+// ast_arena_release() frees every node at once, without running
+// destructors.  Threads may allocate concurrently: each one bumps through
+// blocks of its own.
+//
+// So a node must not own memory outside the arena.  The ones that hold a
+// variable number of children, flat lists (flat-list.h) and let_multi
+// (let-multi.h), keep them in an ast_arena_array, and are themselves
+// arena nodes.  What outlives a release is only what never was in the
+// arena: the symbols of the string tables and the list nodes of tree.h
+// (nil, single and append), which are allocated with plain new and never
+// freed.
+//
+void *ast_arena_allocate(size_t size);
+void ast_arena_release();
+
+// Arena memory that is not a node of its own, such as the items of an
+// ast_arena_array; counted in bytes but not in nodes.
+void *ast_arena_allocate_data(size_t size);
+
+//
+// Allocations are counted per phase.  Until ast_arena_phase() is first
+// called the phase is "parse".  With COOL_ARENA_STATS set in the
+// environment, the counts are written to cerr at exit.
+//
+void ast_arena_phase(const char *name);
+void ast_arena_report(std::ostream &stream);
+
+//
+// A node takes its line number from node_lineno, which only one parser at
+// a time can set.  While files are parsed on several threads, each parser
+// points parse_node_lineno at the line number for the nodes it builds; the
+// phylum constructors (AST_NODE_LINENO) use that instead.
+//
+extern thread_local int *parse_node_lineno;
+
+#define AST_NODE_LINENO             \
+    if (parse_node_lineno != NULL) \
+        line_number = *parse_node_lineno;
+
+#define AST_ARENA_OPERATORS                                                      \
+    static void *operator new(size_t size) { return ast_arena_allocate(size); } \
+    static void operator delete(void *) {}
+
+//
+// A growable array in arena memory.  Growing copies the items to a new
+// allocation twice the size and leaves the old one to the arena, so there
+// is never anything to free or destroy: T must be trivially copyable.
+//
+template <class T>
+class ast_arena_array
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "ast_arena_array items are copied with memcpy and never destroyed");
+
+    T *items;
+    int count;
+    int capacity;
+
+public:
+    ast_arena_array() : items(NULL), count(0), capacity(0) {}
+
+    void reserve(int n)
+    {
+        if (n <= capacity)
+            return;
+        T *grown = (T *)ast_arena_allocate_data(n * sizeof(T));
+        if (count > 0)
+            memcpy(grown, items, count * sizeof(T));
+        items = grown;
+        capacity = n;
+    }
+    void push_back(const T &item)
+    {
+        if (count == capacity)
+            reserve(capacity < 4 ? 4 : 2 * capacity);
+        items[count++] = item;
+    }
+    int size() const { return count; }
+    T &operator[](int n) { return items[n]; }
+    const T &operator[](int n) const { return items[n]; }
+};
+
+#endif
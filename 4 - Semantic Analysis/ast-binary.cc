@@ -0,0 +1,742 @@
+//
+// The binary AST format of ast-binary.h: write_binary() for every node
+// class, and the loader.  The loader interns symbols through the same
+// hash index as the scanner (symbol-index.h, in the lexer directory), so
+// loading is linear in the size of the file.
+//
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include "ast-binary.h"
+#include "let-multi.h"
+#include "symbol-index.h"
+
+static const char ast_magic[8] = {'C', 'O', 'O', 'L', 'A', 'S', 'T', '1'};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Writing
+//
+//////////////////////////////////////////////////////////////////////
+
+void ast_writer::varint(std::string &out, uint64_t n)
+{
+    while (n >= 0x80)
+    {
+        out += (char)(n | 0x80);
+        n >>= 7;
+    }
+    out += (char)n;
+}
+
+void ast_writer::begin(ast_kind kind, tree_node *node)
+{
+    nodes += (char)kind;
+    lineno(node->get_line_number());
+}
+
+void ast_writer::lineno(int n)
+{
+    int delta = n - line;
+    line = n;
+    varint(nodes, ((uint64_t)(int64_t)delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+}
+
+uint64_t ast_writer::symbol_id(Symbol s, ast_symbol_table table)
+{
+    std::unordered_map<Symbol, uint64_t>::iterator i = symbol_index.find(s);
+    if (i == symbol_index.end())
+    {
+        i = symbol_index.insert(std::make_pair(s, (uint64_t)symbol_index.size())).first;
+        symbols += (char)table;
+        varint(symbols, s->get_len());
+        symbols.append(s->get_string(), s->get_len());
+    }
+    return i->second;
+}
+
+void ast_writer::symbol(Symbol s, ast_symbol_table table)
+{
+    varint(nodes, symbol_id(s, table));
+}
+
+// Expression types are idtable symbols, or NULL before semant.
+void ast_writer::type(Symbol s)
+{
+    varint(nodes, s == NULL ? 0 : symbol_id(s, AST_IDTABLE) + 1);
+}
+
+void ast_writer::finish(std::string &out)
+{
+    out.assign(ast_magic, sizeof(ast_magic));
+    varint(out, symbol_index.size());
+    out += symbols;
+    out += nodes;
+}
+
+void program_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_PROGRAM, this);
+    w.list(classes);
+}
+
+void class__class::write_binary(ast_writer &w)
+{
+    w.begin(AST_CLASS, this);
+    w.symbol(name);
+    w.symbol(parent);
+    w.list(features);
+    w.symbol(filename, AST_STRTABLE);
+}
+
+void method_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_METHOD, this);
+    w.symbol(name);
+    w.list(formals);
+    w.symbol(return_type);
+    expr->write_binary(w);
+}
+
+void attr_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_ATTR, this);
+    w.symbol(name);
+    w.symbol(type_decl);
+    init->write_binary(w);
+}
+
+void formal_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_FORMAL, this);
+    w.symbol(name);
+    w.symbol(type_decl);
+}
+
+void branch_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_BRANCH, this);
+    w.symbol(name);
+    w.symbol(type_decl);
+    expr->write_binary(w);
+}
+
+void assign_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_ASSIGN, this);
+    w.symbol(name);
+    expr->write_binary(w);
+    w.type(type);
+}
+
+void static_dispatch_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_STATIC_DISPATCH, this);
+    expr->write_binary(w);
+    w.symbol(type_name);
+    w.symbol(name);
+    w.list(actual);
+    w.type(type);
+}
+
+void dispatch_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_DISPATCH, this);
+    expr->write_binary(w);
+    w.symbol(name);
+    w.list(actual);
+    w.type(type);
+}
+
+void cond_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_COND, this);
+    pred->write_binary(w);
+    then_exp->write_binary(w);
+    else_exp->write_binary(w);
+    w.type(type);
+}
+
+void loop_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_LOOP, this);
+    pred->write_binary(w);
+    body->write_binary(w);
+    w.type(type);
+}
+
+void typcase_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_TYPCASE, this);
+    expr->write_binary(w);
+    w.list(cases);
+    w.type(type);
+}
+
+void block_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_BLOCK, this);
+    w.list(body);
+    w.type(type);
+}
+
+void let_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_LET, this);
+    w.symbol(identifier);
+    w.symbol(type_decl);
+    init->write_binary(w);
+    body->write_binary(w);
+    w.type(type);
+}
+
+void let_multi_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_LET_MULTI, this);
+    w.count(bindings.size());
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        w.lineno(bindings[i].line);
+        w.symbol(bindings[i].identifier);
+        w.symbol(bindings[i].type_decl);
+        bindings[i].init->write_binary(w);
+    }
+    body->write_binary(w);
+    w.type(type);
+}
+
+#define BINARY_OPERATOR(name, kind)                \
+    void name##_class::write_binary(ast_writer &w) \
+    {                                              \
+        w.begin(kind, this);                       \
+        e1->write_binary(w);                       \
+        e2->write_binary(w);                       \
+        w.type(type);                              \
+    }
+
+BINARY_OPERATOR(plus, AST_PLUS)
+BINARY_OPERATOR(sub, AST_SUB)
+BINARY_OPERATOR(mul, AST_MUL)
+BINARY_OPERATOR(divide, AST_DIVIDE)
+BINARY_OPERATOR(lt, AST_LT)
+BINARY_OPERATOR(eq, AST_EQ)
+BINARY_OPERATOR(leq, AST_LEQ)
+
+void neg_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_NEG, this);
+    e1->write_binary(w);
+    w.type(type);
+}
+
+void comp_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_COMP, this);
+    e1->write_binary(w);
+    w.type(type);
+}
+
+void int_const_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_INT_CONST, this);
+    w.symbol(token, AST_INTTABLE);
+    w.type(type);
+}
+
+void bool_const_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_BOOL_CONST, this);
+    w.boolean(val);
+    w.type(type);
+}
+
+void string_const_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_STRING_CONST, this);
+    w.symbol(token, AST_STRTABLE);
+    w.type(type);
+}
+
+void new__class::write_binary(ast_writer &w)
+{
+    w.begin(AST_NEW, this);
+    w.symbol(type_name);
+    w.type(type);
+}
+
+void isvoid_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_ISVOID, this);
+    e1->write_binary(w);
+    w.type(type);
+}
+
+void no_expr_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_NO_EXPR, this);
+    w.type(type);
+}
+
+void object_class::write_binary(ast_writer &w)
+{
+    w.begin(AST_OBJECT, this);
+    w.symbol(name);
+    w.type(type);
+}
+
+void ast_write_binary(Program program, std::string &out)
+{
+    ast_writer w;
+    program->write_binary(w);
+    w.finish(out);
+}
+
+bool ast_write_binary(Program program, const char *filename)
+{
+    std::string out;
+    ast_write_binary(program, out);
+    std::ofstream file(filename, std::ios::binary);
+    file.write(out.data(), out.size());
+    return file.good();
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Loading
+//
+// A reader walks the nodes in the order they were written and builds
+// each node with its constructor once its fields are read, with
+// node_lineno set to its line.  Any inconsistency (a bad kind, an index
+// out of range, the end of the data in mid-node, expressions nested more
+// than max_depth deep) marks the reader as failed, after which it builds
+// no more nodes.
+//
+//////////////////////////////////////////////////////////////////////
+
+class ast_reader
+{
+    // Each level of expression() takes stack.  The text form is read by a
+    // Bison parser, which gives up at YYMAXDEPTH (10000) levels of nesting,
+    // so no tree it can hand over is deeper than this.
+    static const int max_depth = 10000;
+
+    const unsigned char *p;
+    const unsigned char *end;
+    std::vector<Symbol> symbols;
+    int line;
+    int depth;
+    bool failed;
+
+    uint64_t varint();
+    int kind();
+    int lineno();
+    Symbol symbol();
+    Symbol type();
+    Expression expression();
+    Class_ class_();
+    Feature feature();
+    Formal formal();
+    Case branch();
+    template <class Elem>
+    list_node<Elem> *list(Elem (ast_reader::*read)());
+
+public:
+    ast_reader(const char *data, size_t len)
+        : p((const unsigned char *)data), end((const unsigned char *)data + len),
+          line(0), depth(0), failed(false) {}
+
+    bool read_symbols();
+    Program program();
+    bool ok() { return !failed && p == end; }
+};
+
+uint64_t ast_reader::varint()
+{
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+            break;
+        unsigned char c = *p++;
+        n |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return n;
+    }
+    failed = true;
+    return 0;
+}
+
+// A node's kind; also moves line to the node's line.
+int ast_reader::kind()
+{
+    if (failed || p == end)
+    {
+        failed = true;
+        return 0;
+    }
+    int k = *p++;
+    lineno();
+    return k;
+}
+
+int ast_reader::lineno()
+{
+    uint64_t zigzag = varint();
+    line += (int)((zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+    return line;
+}
+
+Symbol ast_reader::symbol()
+{
+    uint64_t i = varint();
+    if (i >= symbols.size())
+    {
+        failed = true;
+        return NULL;
+    }
+    return symbols[i];
+}
+
+Symbol ast_reader::type()
+{
+    uint64_t i = varint();
+    if (i > symbols.size())
+    {
+        failed = true;
+        return NULL;
+    }
+    return i == 0 ? NULL : symbols[i - 1];
+}
+
+bool ast_reader::read_symbols()
+{
+    static SymbolIndex<IdEntry> ids(idtable);
+    static SymbolIndex<IntEntry> ints(inttable);
+    static SymbolIndex<StringEntry> strings(stringtable);
+
+    if ((size_t)(end - p) < sizeof(ast_magic) || memcmp(p, ast_magic, sizeof(ast_magic)) != 0)
+        return false;
+    p += sizeof(ast_magic);
+
+    uint64_t count = varint();
+    if (count > (uint64_t)(end - p))
+        return false;
+    symbols.reserve(count);
+    for (uint64_t i = 0; i < count && !failed; i++)
+    {
+        int table = p < end ? *p++ : -1;
+        uint64_t len = varint();
+        if (len > (uint64_t)(end - p))
+            return false;
+        const char *s = (const char *)p;
+        p += len;
+        switch (table)
+        {
+        case AST_IDTABLE:
+            symbols.push_back(ids.intern(s, len));
+            break;
+        case AST_INTTABLE:
+            symbols.push_back(ints.intern(s, len));
+            break;
+        case AST_STRTABLE:
+            symbols.push_back(strings.intern(s, len));
+            break;
+        default:
+            return false;
+        }
+    }
+    return !failed;
+}
+
+template <class Elem>
+list_node<Elem> *ast_reader::list(Elem (ast_reader::*read)())
+{
+    list_node<Elem> *l = flat_nil<Elem>();
+    uint64_t count = varint();
+    if (count > (uint64_t)(end - p))
+        failed = true;
+    for (uint64_t i = 0; i < count && !failed; i++)
+        flat_push(l, (this->*read)());
+    return l;
+}
+
+Program ast_reader::program()
+{
+    if (kind() != AST_PROGRAM)
+    {
+        failed = true;
+        return NULL;
+    }
+    int l = line;
+    Classes classes = list(&ast_reader::class_);
+    if (failed)
+        return NULL;
+    node_lineno = l;
+    return ::program(classes);
+}
+
+Class_ ast_reader::class_()
+{
+    if (kind() != AST_CLASS)
+    {
+        failed = true;
+        return NULL;
+    }
+    int l = line;
+    Symbol name = symbol();
+    Symbol parent = symbol();
+    Features features = list(&ast_reader::feature);
+    Symbol filename = symbol();
+    if (failed)
+        return NULL;
+    node_lineno = l;
+    return ::class_(name, parent, features, filename);
+}
+
+Feature ast_reader::feature()
+{
+    int k = kind();
+    int l = line;
+    Symbol name = symbol();
+    Feature f = NULL;
+    if (k == AST_METHOD)
+    {
+        Formals formals = list(&ast_reader::formal);
+        Symbol return_type = symbol();
+        Expression expr = expression();
+        node_lineno = l;
+        if (!failed)
+            f = method(name, formals, return_type, expr);
+    }
+    else if (k == AST_ATTR)
+    {
+        Symbol type_decl = symbol();
+        Expression init = expression();
+        node_lineno = l;
+        if (!failed)
+            f = attr(name, type_decl, init);
+    }
+    else
+        failed = true;
+    return f;
+}
+
+Formal ast_reader::formal()
+{
+    if (kind() != AST_FORMAL)
+    {
+        failed = true;
+        return NULL;
+    }
+    int l = line;
+    Symbol name = symbol();
+    Symbol type_decl = symbol();
+    if (failed)
+        return NULL;
+    node_lineno = l;
+    return ::formal(name, type_decl);
+}
+
+Case ast_reader::branch()
+{
+    if (kind() != AST_BRANCH)
+    {
+        failed = true;
+        return NULL;
+    }
+    int l = line;
+    Symbol name = symbol();
+    Symbol type_decl = symbol();
+    Expression expr = expression();
+    if (failed)
+        return NULL;
+    node_lineno = l;
+    return ::branch(name, type_decl, expr);
+}
+
+Expression ast_reader::expression()
+{
+    struct nesting
+    {
+        int &depth;
+        nesting(int &depth) : depth(depth) { depth++; }
+        ~nesting() { depth--; }
+    } nested(depth);
+
+    if (depth > max_depth)
+    {
+        failed = true;
+        return NULL;
+    }
+
+    int k = kind();
+    int l = line;
+    Expression e1 = NULL, e2 = NULL, e3 = NULL;
+    Symbol s1 = NULL, s2 = NULL;
+    Expressions actual = NULL;
+    Cases cases = NULL;
+    Boolean b = 0;
+    std::vector<let_binding> bindings;
+
+    // the fields, in the order write_binary() wrote them
+    switch (k)
+    {
+    case AST_ASSIGN:
+        s1 = symbol();
+        e1 = expression();
+        break;
+    case AST_STATIC_DISPATCH:
+        e1 = expression();
+        s1 = symbol();
+        s2 = symbol();
+        actual = list(&ast_reader::expression);
+        break;
+    case AST_DISPATCH:
+        e1 = expression();
+        s1 = symbol();
+        actual = list(&ast_reader::expression);
+        break;
+    case AST_COND:
+        e1 = expression();
+        e2 = expression();
+        e3 = expression();
+        break;
+    case AST_TYPCASE:
+        e1 = expression();
+        cases = list(&ast_reader::branch);
+        break;
+    case AST_BLOCK:
+        actual = list(&ast_reader::expression);
+        break;
+    case AST_LET:
+        s1 = symbol();
+        s2 = symbol();
+        e1 = expression();
+        e2 = expression();
+        break;
+    case AST_LET_MULTI:
+    {
+        uint64_t count = varint();
+        if (count == 0 || count > (uint64_t)(end - p))
+            failed = true;
+        for (uint64_t i = 0; i < count && !failed; i++)
+        {
+            let_binding binding;
+            binding.line = lineno();
+            binding.identifier = symbol();
+            binding.type_decl = symbol();
+            binding.init = expression();
+            bindings.push_back(binding);
+        }
+        e1 = expression();
+        break;
+    }
+    case AST_LOOP:
+    case AST_PLUS:
+    case AST_SUB:
+    case AST_MUL:
+    case AST_DIVIDE:
+    case AST_LT:
+    case AST_EQ:
+    case AST_LEQ:
+        e1 = expression();
+        e2 = expression();
+        break;
+    case AST_NEG:
+    case AST_COMP:
+    case AST_ISVOID:
+        e1 = expression();
+        break;
+    case AST_BOOL_CONST:
+        if (p == end)
+            failed = true;
+        else
+            b = *p++;
+        break;
+    case AST_INT_CONST:
+    case AST_STRING_CONST:
+    case AST_NEW:
+    case AST_OBJECT:
+        s1 = symbol();
+        break;
+    case AST_NO_EXPR:
+        break;
+    default:
+        failed = true;
+    }
+    Symbol t = type();
+    if (failed)
+        return NULL;
+
+    node_lineno = l;
+    Expression e = NULL;
+    switch (k)
+    {
+    case AST_ASSIGN: e = assign(s1, e1); break;
+    case AST_STATIC_DISPATCH: e = static_dispatch(e1, s1, s2, actual); break;
+    case AST_DISPATCH: e = dispatch(e1, s1, actual); break;
+    case AST_COND: e = cond(e1, e2, e3); break;
+    case AST_LOOP: e = loop(e1, e2); break;
+    case AST_TYPCASE: e = typcase(e1, cases); break;
+    case AST_BLOCK: e = block(actual); break;
+    case AST_LET: e = let(s1, s2, e1, e2); break;
+    case AST_LET_MULTI:
+        e = let_multi(bindings[0].line, bindings[0].identifier, bindings[0].type_decl,
+                      bindings[0].init);
+        for (size_t i = 1; i < bindings.size(); i++)
+            let_multi_push(e, bindings[i].line, bindings[i].identifier, bindings[i].type_decl,
+                           bindings[i].init);
+        let_multi_body(e, e1);
+        break;
+    case AST_PLUS: e = plus(e1, e2); break;
+    case AST_SUB: e = sub(e1, e2); break;
+    case AST_MUL: e = mul(e1, e2); break;
+    case AST_DIVIDE: e = divide(e1, e2); break;
+    case AST_NEG: e = neg(e1); break;
+    case AST_LT: e = lt(e1, e2); break;
+    case AST_EQ: e = eq(e1, e2); break;
+    case AST_LEQ: e = leq(e1, e2); break;
+    case AST_COMP: e = comp(e1); break;
+    case AST_INT_CONST: e = int_const(s1); break;
+    case AST_BOOL_CONST: e = bool_const(b); break;
+    case AST_STRING_CONST: e = string_const(s1); break;
+    case AST_NEW: e = new_(s1); break;
+    case AST_ISVOID: e = isvoid(e1); break;
+    case AST_NO_EXPR: e = no_expr(); break;
+    case AST_OBJECT: e = object(s1); break;
+    }
+    return e->set_type(t);
+}
+
+Program ast_read_binary(const char *data, size_t len)
+{
+    ast_reader reader(data, len);
+    if (!reader.read_symbols())
+        return NULL;
+    Program program = reader.program();
+    return reader.ok() ? program : NULL;
+}
+
+Program ast_read_binary(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    Program program = ast_read_binary((const char *)data, st.st_size);
+    munmap(data, st.st_size);
+    return program;
+}
@@ -0,0 +1,116 @@
+#ifndef AST_BINARY_H
+#define AST_BINARY_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "cool-tree.h"
+
+//
+// A compact binary form of the AST, to pass from the parser to semant
+// instead of the dump_with_types() text, which semant has to parse again.
+// The text form stays the one for reading and debugging.
+//
+// A file is the magic "COOLAST1", the symbol table, then the program node.
+// Numbers are LEB128 varints.  The symbol table is a count followed by
+// entries of a table byte (ast_symbol_table), a length and the bytes; a
+// symbol is referred to by its index in it.  A node is its kind byte
+// (ast_kind), the zigzag-coded difference between its line and the line
+// of the node before it, then its fields in constructor order: symbols as
+// indices, Booleans as a byte, subtrees in place, lists as a count and the
+// elements.  An expression ends with its type: 0 for none, else the index
+// of the symbol plus one.
+//
+// A let_multi (let-multi.h) has the count of its bindings, each as the
+// difference of its line, its two symbols and its init, then its body.
+//
+
+enum ast_symbol_table
+{
+    AST_IDTABLE,
+    AST_INTTABLE,
+    AST_STRTABLE
+};
+
+enum ast_kind
+{
+    AST_PROGRAM = 1,
+    AST_CLASS,
+    AST_METHOD,
+    AST_ATTR,
+    AST_FORMAL,
+    AST_BRANCH,
+    AST_ASSIGN,
+    AST_STATIC_DISPATCH,
+    AST_DISPATCH,
+    AST_COND,
+    AST_LOOP,
+    AST_TYPCASE,
+    AST_BLOCK,
+    AST_LET,
+    AST_PLUS,
+    AST_SUB,
+    AST_MUL,
+    AST_DIVIDE,
+    AST_NEG,
+    AST_LT,
+    AST_EQ,
+    AST_LEQ,
+    AST_COMP,
+    AST_INT_CONST,
+    AST_BOOL_CONST,
+    AST_STRING_CONST,
+    AST_NEW,
+    AST_ISVOID,
+    AST_NO_EXPR,
+    AST_OBJECT,
+    AST_LET_MULTI
+};
+
+//
+// Encodes nodes for their write_binary() methods.  Nodes go to one buffer
+// and the symbols they refer to are collected in another; finish() puts
+// the file together.
+//
+class ast_writer
+{
+    std::string symbols;
+    std::string nodes;
+    std::unordered_map<Symbol, uint64_t> symbol_index;
+    int line;
+
+    static void varint(std::string &out, uint64_t n);
+    uint64_t symbol_id(Symbol s, ast_symbol_table table);
+
+public:
+    ast_writer() : line(0) {}
+
+    void begin(ast_kind kind, tree_node *node);
+    void lineno(int n);
+    void symbol(Symbol s, ast_symbol_table table = AST_IDTABLE);
+    void type(Symbol s);
+    void boolean(Boolean b) { nodes += (char)(b != 0); }
+    void count(size_t n) { varint(nodes, n); }
+    template <class Elem>
+    void list(list_node<Elem> *l)
+    {
+        varint(nodes, l->len());
+        for (int i = l->first(); l->more(i); i = l->next(i))
+            l->nth(i)->write_binary(*this);
+    }
+    void finish(std::string &out);
+};
+
+void ast_write_binary(Program program, std::string &out);
+bool ast_write_binary(Program program, const char *filename);
+
+//
+// Rebuild a program from the binary form, with symbols in idtable,
+// inttable and stringtable and line numbers as written.  The file is
+// mapped, not read.  NULL if the file cannot be opened or is not a binary
+// AST, so a caller can fall back to the text form.
+//
+Program ast_read_binary(const char *filename);
+Program ast_read_binary(const char *data, size_t len);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ *  astbench.cc
+ *              Text against binary AST handoff (ast-binary.h).
+ *
+ *  astbench is linked like semant, with this file in place of
+ *  semant-phase.cc:
+ *
+ *      g++ -O2 -I"../2 - Lexer" -o astbench astbench.cc ast-binary.cc \
+ *          ast-arena.cc let-multi.cc semant.cc ast-lex.cc ast-parse.cc cool-tree.cc \
+ *          dumptype.cc tree.cc utilities.cc stringtab.cc handle_flags.cc
+ *
+ *  It builds a synthetic program of --classes classes, each with
+ *  --features methods whose bodies are random expression trees, and hands
+ *  it over both ways: dump_with_types() and the AST parser that semant
+ *  uses, and ast_write_binary() and ast_read_binary().  One JSON object
+ *  per format goes to stdout:
+ *
+ *      {"format": "binary", "classes": ..., "nodes": ..., "bytes": ...,
+ *       "write_seconds": ..., "read_seconds": ..., "peak_rss_kb": ...}
+ *
+ *  Times are the best of --runs for both formats; the AST scanner is
+ *  restarted on the text file for each run.  Every format must give back a
+ *  program that dumps the same as the original, or astbench fails.
+ *
+ *  peak_rss_kb is the peak resident size of the whole process so far, so
+ *  after the first format it includes the memory of the one before.  To
+ *  compare the memory of the two, run each in a process of its own with
+ *  --format.
+ *
+ *  usage: astbench [--classes N] [--features N] [--depth N] [--runs N]
+ *                  [--format text|binary]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "ast-binary.h"
+
+FILE *ast_file = stdin; // read by the AST scanner
+extern int ast_yyparse(void);
+extern void ast_yyrestart(FILE *);
+extern Program ast_root;
+
+int cool_yydebug;
+char *curr_filename = (char *)"<astbench>";
+
+static long nodes = 0;
+
+static unsigned next_random(unsigned &seed)
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 16;
+}
+
+static Symbol id(const char *s)
+{
+    return idtable.add_string((char *)s);
+}
+
+// A random expression tree of the given depth; a fixed seed keeps the
+// program the same from run to run.
+static Expression gen_expression(int depth, unsigned &seed)
+{
+    static const char *names[] = {"x", "y", "count", "self", "next", "value"};
+    unsigned k = next_random(seed);
+    node_lineno = 1 + k % 5000;
+    nodes++;
+
+    if (depth == 0)
+    {
+        switch (k % 4)
+        {
+        case 0:
+            return int_const(inttable.add_int(k % 1000));
+        case 1:
+            return string_const(stringtable.add_string((char *)"a string constant"));
+        case 2:
+            return bool_const(k & 1);
+        default:
+            return object(id(names[k % 6]));
+        }
+    }
+
+    Expression a = gen_expression(depth - 1, seed);
+    Expression b = gen_expression(depth - 1, seed);
+    Expressions args;
+    Cases cases;
+    switch (k % 10)
+    {
+    case 0:
+        return plus(a, b);
+    case 1:
+        return lt(a, b);
+    case 2:
+        return let(id(names[k % 6]), id("Int"), a, b);
+    case 3:
+        nodes++;
+        return cond(a, b, no_expr());
+    case 4:
+        args = flat_nil<Expression>();
+        flat_push(args, a);
+        flat_push(args, b);
+        return block(args);
+    case 5:
+        args = flat_nil<Expression>();
+        flat_push(args, b);
+        return dispatch(a, id("method"), args);
+    case 6:
+        cases = flat_nil<Case>();
+        flat_push(cases, branch(id("n"), id("Int"), b));
+        flat_push(cases, branch(id("o"), id("Object"), no_expr()));
+        nodes += 3;
+        return typcase(a, cases);
+    case 7:
+        return assign(id(names[k % 6]), a);
+    case 8:
+        return loop(a, b);
+    default:
+        nodes++;
+        return eq(a, isvoid(b));
+    }
+}
+
+static Program gen_program(int classes, int features, int depth)
+{
+    unsigned seed = 1;
+    Classes cs = flat_nil<Class_>();
+    for (int c = 0; c < classes; c++)
+    {
+        Features fs = flat_nil<Feature>();
+        for (int f = 0; f < features; f++)
+        {
+            Formals formals = flat_nil<Formal>();
+            flat_push(formals, formal(id("x"), id("Int")));
+            flat_push(fs, method(id("method"), formals, id("Int"), gen_expression(depth, seed)));
+            nodes += 2;
+        }
+        std::string name = "C" + std::to_string(c);
+        flat_push(cs, class_(id(name.c_str()), id("Object"), fs,
+                             stringtable.add_string((char *)"bench.cl")));
+        nodes++;
+    }
+    nodes++;
+    return program(cs);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static std::string dump(Program program)
+{
+    std::ostringstream out;
+    program->dump_with_types(out, 0);
+    return out.str();
+}
+
+static void report(const char *format, int classes, size_t bytes, double write_seconds,
+                   double read_seconds)
+{
+    printf("{\"format\": \"%s\", \"classes\": %d, \"nodes\": %ld, \"bytes\": %zu, "
+           "\"write_seconds\": %.6f, \"read_seconds\": %.6f, \"peak_rss_kb\": %ld}\n",
+           format, classes, nodes, bytes, write_seconds, read_seconds, peak_rss_kb());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int classes = 200, features = 20, depth = 6, runs = 5;
+    const char *format = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--classes") == 0 && i + 1 < argc)
+            classes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--features") == 0 && i + 1 < argc)
+            features = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+            format = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--classes N] [--features N] [--depth N] [--runs N] "
+                            "[--format text|binary]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (format != NULL && strcmp(format, "text") != 0 && strcmp(format, "binary") != 0)
+    {
+        fprintf(stderr, "astbench: unknown format %s\n", format);
+        return 1;
+    }
+    if (runs < 1)
+        runs = 1;
+
+    Program program = gen_program(classes, features, depth);
+    std::string expected = dump(program);
+    char text_path[] = "/tmp/astbench.XXXXXX";
+    char binary_path[] = "/tmp/astbench.XXXXXX";
+    close(mkstemp(text_path));
+    close(mkstemp(binary_path));
+    int failed = 0;
+
+    // text: dump_with_types() and the AST parser
+    if (format == NULL || strcmp(format, "text") == 0)
+    {
+        double write_best = 0, read_best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now();
+            std::ofstream out(text_path);
+            program->dump_with_types(out, 0);
+            out.close();
+            double seconds = now() - start;
+            if (i == 0 || seconds < write_best)
+                write_best = seconds;
+
+            start = now();
+            ast_file = fopen(text_path, "r");
+            ast_yyrestart(ast_file);
+            ast_root = NULL;
+            ast_yyparse();
+            fclose(ast_file);
+            seconds = now() - start;
+            if (i == 0 || seconds < read_best)
+                read_best = seconds;
+            if (i == 0 && (ast_root == NULL || dump(ast_root) != expected))
+            {
+                fprintf(stderr, "astbench: text handoff changed the program\n");
+                failed++;
+            }
+        }
+        report("text", classes, expected.size(), write_best, read_best);
+    }
+
+    // binary: ast_write_binary() and ast_read_binary()
+    if (format == NULL || strcmp(format, "binary") == 0)
+    {
+        std::string binary;
+        double write_best = 0, read_best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now();
+            ast_write_binary(program, binary_path);
+            double seconds = now() - start;
+            if (i == 0 || seconds < write_best)
+                write_best = seconds;
+
+            start = now();
+            Program loaded = ast_read_binary(binary_path);
+            seconds = now() - start;
+            if (i == 0 || seconds < read_best)
+                read_best = seconds;
+            if (i == 0 && (loaded == NULL || dump(loaded) != expected))
+            {
+                fprintf(stderr, "astbench: binary handoff changed the program\n");
+                failed++;
+            }
+        }
+        ast_write_binary(program, binary);
+        report("binary", classes, binary.size(), write_best, read_best);
+    }
+
+    unlink(text_path);
+    unlink(binary_path);
+    return failed != 0;
+}
@@ -8,6 +8,9 @@
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
+#include "ast-arena.h"
+#include "flat-list.h"
+class ast_writer; // ast-binary.h
 #define yylineno curr_lineno;
 extern int yylineno;
 
@@ -46,17 +49,24 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
-#define Program_EXTRAS         \
-	virtual void semant() = 0; \
-	virtual void dump_with_types(ostream &, int) = 0;
+#define Program_EXTRAS                                \
+	AST_ARENA_OPERATORS                               \
+	Program_class() { AST_NODE_LINENO }               \
+	virtual void semant() = 0;                        \
+	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;
 
-#define program_EXTRAS \
-	void semant();     \
-	void dump_with_types(ostream &, int);
+#define program_EXTRAS                    \
+	void semant();                        \
+	void dump_with_types(ostream &, int); \
+	void write_binary(ast_writer &);
 
 #define Class__EXTRAS                                 \
+	AST_ARENA_OPERATORS                               \
+	Class__class() { AST_NODE_LINENO }                \
 	virtual Symbol get_filename() = 0;                \
 	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;      \
 	virtual Symbol get_name() = 0;                    \
 	virtual Symbol get_parent() = 0;                  \
 	virtual Features get_features() = 0;
@@ -64,18 +74,23 @@ typedef Cases_class *Cases;
 #define class__EXTRAS                          \
 	Symbol get_filename() { return filename; } \
 	void dump_with_types(ostream &, int);      \
+	void write_binary(ast_writer &);           \
 	Symbol get_name() { return name; }         \
 	Symbol get_parent() { return parent; }     \
 	Features get_features() { return features; }
 
 #define Feature_EXTRAS                                \
+	AST_ARENA_OPERATORS                               \
+	Feature_class() { AST_NODE_LINENO }               \
 	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;      \
 	virtual bool is_method() = 0;                     \
 	virtual bool is_attr() = 0;                       \
 	virtual Symbol get_name() = 0;
 
-#define Feature_SHARED_EXTRAS \
-	void dump_with_types(ostream &, int);
+#define Feature_SHARED_EXTRAS             \
+	void dump_with_types(ostream &, int); \
+	void write_binary(ast_writer &);
 
 #define method_EXTRAS                                \
 	bool is_method() { return true; }                \
@@ -94,27 +109,36 @@ typedef Cases_class *Cases;
 	Expression get_expr() { return init; }
 
 #define Formal_EXTRAS                                 \
+	AST_ARENA_OPERATORS                               \
+	Formal_class() { AST_NODE_LINENO }                \
 	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;      \
 	virtual Symbol get_name() = 0;                    \
 	virtual Symbol get_type() = 0;
 
 #define formal_EXTRAS                     \
 	void dump_with_types(ostream &, int); \
+	void write_binary(ast_writer &);      \
 	Symbol get_name() { return name; }    \
 	Symbol get_type() { return type_decl; }
 
 #define Case_EXTRAS                                   \
+	AST_ARENA_OPERATORS                               \
+	Case_class() { AST_NODE_LINENO }                  \
 	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;      \
 	Symbol type;                                      \
 	Symbol get_type() { return type; }                \
 	virtual Symbol inference_type() = 0;
 
 #define branch_EXTRAS                     \
 	void dump_with_types(ostream &, int); \
+	void write_binary(ast_writer &);      \
 	Symbol inference_type();              \
 	Symbol get_type_decl() { return type_decl; }
 
 #define Expression_EXTRAS                             \
+	AST_ARENA_OPERATORS                               \
 	Symbol type;                                      \
 	Symbol get_type() { return type; }                \
 	Expression set_type(Symbol s)                     \
@@ -123,12 +147,18 @@ typedef Cases_class *Cases;
 		return this;                                  \
 	}                                                 \
 	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void write_binary(ast_writer &) = 0;      \
 	void dump_type(ostream &, int);                   \
-	Expression_class() { type = (Symbol)NULL; }       \
+	Expression_class()                                \
+	{                                                 \
+		type = (Symbol)NULL;                          \
+		AST_NODE_LINENO                               \
+	}                                                 \
 	virtual Symbol inference_type() = 0;
 
 #define Expression_SHARED_EXTRAS          \
 	void dump_with_types(ostream &, int); \
+	void write_binary(ast_writer &);      \
 	Symbol inference_type();
 
 #endif
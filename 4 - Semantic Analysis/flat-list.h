@@ -0,0 +1,72 @@
+#ifndef FLAT_LIST_H
+#define FLAT_LIST_H
+
+#include "tree.h"
+#include "ast-arena.h"
+
+//
+// A list_node whose elements sit in one array.  The lists of tree.h are
+// trees of append_nodes, so nth(i) walks down the appends and a loop
+// over first()/more()/next() is quadratic in the length of the list;
+// here len() and nth(i) are O(1).  The parser builds its lists with
+// flat_single() and flat_push(), from left-recursive rules.
+//
+// Unlike the lists of tree.h, a flat list is an arena node, elements and
+// all, and goes at ast_arena_release() with the nodes in it.
+//
+template <class Elem>
+class flat_list_node : public list_node<Elem>
+{
+	ast_arena_array<Elem> elems;
+
+public:
+	AST_ARENA_OPERATORS
+
+	void push_back(Elem e) { elems.push_back(e); }
+
+	list_node<Elem> *copy_list()
+	{
+		flat_list_node<Elem> *l = new flat_list_node<Elem>();
+		l->elems.reserve(elems.size());
+		for (int i = 0; i < elems.size(); i++)
+			l->elems.push_back((Elem)elems[i]->copy());
+		return l;
+	}
+	int len() { return elems.size(); }
+	Elem nth_length(int n, int &len)
+	{
+		len = elems.size();
+		return (n >= 0 && n < len) ? elems[n] : NULL;
+	}
+	void dump(ostream &stream, int n)
+	{
+		stream << pad(n) << "list\n";
+		for (int i = 0; i < elems.size(); i++)
+			elems[i]->dump(stream, n + 2);
+		stream << pad(n) << "(end_of_list)\n";
+	}
+};
+
+template <class Elem>
+list_node<Elem> *flat_nil()
+{
+	return new flat_list_node<Elem>();
+}
+
+template <class Elem>
+list_node<Elem> *flat_single(Elem e)
+{
+	flat_list_node<Elem> *l = new flat_list_node<Elem>();
+	l->push_back(e);
+	return l;
+}
+
+// l must come from flat_nil() or flat_single().
+template <class Elem>
+list_node<Elem> *flat_push(list_node<Elem> *l, Elem e)
+{
+	static_cast<flat_list_node<Elem> *>(l)->push_back(e);
+	return l;
+}
+
+#endif
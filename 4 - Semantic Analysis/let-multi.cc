@@ -0,0 +1,92 @@
+//
+// let_multi (let-multi.h): the node, its text forms and the nested lets it
+// stands for.  inference_type() is in semant.cc and write_binary() in
+// ast-binary.cc, with those of the other nodes.
+//
+#include "let-multi.h"
+
+extern int node_lineno;
+
+Expression let_multi(int line, Symbol identifier, Symbol type_decl, Expression init)
+{
+    return let_multi_push(new let_multi_class(), line, identifier, type_decl, init);
+}
+
+// l must come from let_multi().
+Expression let_multi_push(Expression l, int line, Symbol identifier, Symbol type_decl,
+                          Expression init)
+{
+    let_binding b = {line, identifier, type_decl, init};
+    static_cast<let_multi_class *>(l)->push_back(b);
+    return l;
+}
+
+Expression let_multi_body(Expression l, Expression body)
+{
+    static_cast<let_multi_class *>(l)->set_body(body);
+    return l;
+}
+
+// The lets are built innermost first, each on the line of its binding and
+// with the type of the whole let, as semant gives every let of a chain
+// the type of the body.
+Expression let_multi_class::to_nested()
+{
+    int &lineno = parse_node_lineno != NULL ? *parse_node_lineno : node_lineno;
+    int saved = lineno;
+    Expression e = body;
+    for (int i = bindings.size(); i-- > 0;)
+    {
+        const let_binding &b = bindings[i];
+        lineno = b.line;
+        e = let(b.identifier, b.type_decl, b.init, e)->set_type(type);
+    }
+    lineno = saved;
+    return e;
+}
+
+Expression let_multi_class::copy_Expression()
+{
+    let_multi_class *l = new let_multi_class();
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        let_binding b = bindings[i];
+        b.init = b.init->copy_Expression();
+        l->push_back(b);
+    }
+    l->set_body(body->copy_Expression());
+    return l;
+}
+
+// The nested lets, without building them: the bindings going in, each
+// one level deeper, and the body at the bottom.
+void let_multi_class::dump(ostream &stream, int n)
+{
+    for (int i = 0; i < bindings.size(); i++, n += 2)
+    {
+        stream << pad(n) << "let\n";
+        dump_Symbol(stream, n + 2, bindings[i].identifier);
+        dump_Symbol(stream, n + 2, bindings[i].type_decl);
+        bindings[i].init->dump(stream, n + 2);
+    }
+    body->dump(stream, n);
+}
+
+// As dump(), with the type of each let on the way out.
+void let_multi_class::dump_with_types(ostream &stream, int n)
+{
+    for (int i = 0; i < bindings.size(); i++, n += 2)
+    {
+        stream << pad(n) << "#" << bindings[i].line << "\n";
+        stream << pad(n) << "_let\n";
+        dump_Symbol(stream, n + 2, bindings[i].identifier);
+        dump_Symbol(stream, n + 2, bindings[i].type_decl);
+        bindings[i].init->dump_with_types(stream, n + 2);
+    }
+    body->dump_with_types(stream, n);
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        n -= 2;
+        dump_type(stream, n);
+    }
+}
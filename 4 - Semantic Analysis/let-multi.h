@@ -0,0 +1,65 @@
+#ifndef LET_MULTI_H
+#define LET_MULTI_H
+
+#include "cool-tree.h"
+
+//
+// One node for a let with all its bindings:
+//
+//     let a : A <- e1, b : B, ... in body
+//
+// cool-tree.h has a let for one binding, so the parser used to build a
+// chain of nested lets, one per binding, and semant checked it one scope
+// and one recursive call per binding.  A let_multi is checked in one scope
+// with the bindings added in order, so each binding still sees the ones
+// before it and shadows them.
+//
+// A let_multi prints (dump() and dump_with_types()) as the nested lets it
+// stands for, so the text forms and the AST parser that reads them back
+// are unchanged.  to_nested() builds those nested lets for code that
+// expects them.
+//
+// The bindings are kept in the arena with the node (see ast-arena.h).
+//
+struct let_binding
+{
+    int line; // of the binding's name, for the nested let and for errors
+    Symbol identifier;
+    Symbol type_decl;
+    Expression init; // no_expr() if none
+};
+
+class let_multi_class : public Expression_class
+{
+protected:
+    ast_arena_array<let_binding> bindings;
+    Expression body;
+
+public:
+    let_multi_class() : body(NULL) {}
+    void push_back(const let_binding &b) { bindings.push_back(b); }
+    void set_body(Expression e) { body = e; }
+    int len() { return bindings.size(); }
+    let_binding &nth(int n) { return bindings[n]; }
+    Expression get_body() { return body; }
+    Expression to_nested();
+    Expression copy_Expression();
+    void dump(ostream &stream, int n);
+
+#ifdef Expression_SHARED_EXTRAS
+    Expression_SHARED_EXTRAS
+#endif
+};
+
+//
+// The parser builds a let_multi like a flat list: let_multi() with the
+// first binding, let_multi_push() for each one after it, and
+// let_multi_body() once the body is parsed.  The node takes its line
+// from node_lineno like any other; a binding's line is given.
+//
+Expression let_multi(int line, Symbol identifier, Symbol type_decl, Expression init);
+Expression let_multi_push(Expression l, int line, Symbol identifier, Symbol type_decl,
+                          Expression init);
+Expression let_multi_body(Expression l, Expression body);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ *  matchbench.cc
+ *              Subtype queries: match() against the LCA() it used to be.
+ *
+ *  matchbench is linked like semant, with this file in place of
+ *  semant-phase.cc:
+ *
+ *      g++ -O2 -I"../2 - Lexer" -o matchbench matchbench.cc ast-binary.cc \
+ *          ast-arena.cc let-multi.cc semant.cc cool-tree.cc dumptype.cc tree.cc \
+ *          utilities.cc stringtab.cc handle_flags.cc
+ *
+ *  It builds a program of --classes classes in the given --shape, runs
+ *  semant on it, and asks --queries random "does A conform to B" questions
+ *  about pairs of its classes, both as match() answers them (the interval
+ *  test) and as LCA(A, B) == B.  One JSON object goes to stdout:
+ *
+ *      {"shape": "deep", "classes": ..., "queries": ..., "conforming": ...,
+ *       "match_seconds": ..., "lca_seconds": ...}
+ *
+ *  The shapes are deep (each class inherits the one before), wide (all
+ *  inherit Object) and tree (each inherits a random earlier class).  Times
+ *  are the best of --runs.  The two must give the same answers, or
+ *  matchbench fails.  semant can run only once in a process, so there is
+ *  one shape per run.
+ *
+ *  usage: matchbench [--shape deep|wide|tree] [--classes N] [--queries N] [--runs N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "semant.h"
+#include "flat-list.h"
+
+// in semant.cc
+extern Symbol LCA(Symbol, Symbol);
+extern bool match(Symbol, Symbol);
+
+int cool_yydebug;
+char *curr_filename = (char *)"<matchbench>";
+
+static unsigned next_random(unsigned &seed)
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 16;
+}
+
+static Symbol id(const char *s)
+{
+    return idtable.add_string((char *)s);
+}
+
+// The classes C0 ... Cn-1 in the given shape, and a Main; names gets the
+// name of each, and Object's.
+static Program gen_program(const char *shape, int classes, std::vector<Symbol> &names)
+{
+    unsigned seed = 1;
+    Symbol filename = stringtable.add_string((char *)"bench.cl");
+    Classes cs = flat_nil<Class_>();
+    names.push_back(id("Object"));
+    for (int c = 0; c < classes; c++)
+    {
+        Symbol parent = names[0];
+        if (strcmp(shape, "deep") == 0)
+            parent = names[c];
+        else if (strcmp(shape, "tree") == 0)
+            parent = names[next_random(seed) % (c + 1)];
+
+        std::string name = "C" + std::to_string(c);
+        names.push_back(id(name.c_str()));
+        flat_push(cs, class_(names.back(), parent, flat_nil<Feature>(), filename));
+    }
+    Features main = flat_nil<Feature>();
+    flat_push(main, method(id("main"), flat_nil<Formal>(), id("Object"),
+                           int_const(inttable.add_int(0))));
+    flat_push(cs, class_(id("Main"), names[0], main, filename));
+    return program(cs);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *shape = "deep";
+    int classes = 1000, queries = 1000000, runs = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc)
+            shape = argv[++i];
+        else if (strcmp(argv[i], "--classes") == 0 && i + 1 < argc)
+            classes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc)
+            queries = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--shape deep|wide|tree] [--classes N] [--queries N] "
+                            "[--runs N]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (strcmp(shape, "deep") != 0 && strcmp(shape, "wide") != 0 && strcmp(shape, "tree") != 0)
+    {
+        fprintf(stderr, "matchbench: unknown shape %s\n", shape);
+        return 1;
+    }
+    if (runs < 1)
+        runs = 1;
+
+    std::vector<Symbol> names;
+    Program program = gen_program(shape, classes, names);
+    program->semant();
+
+    unsigned seed = 2;
+    std::vector<Symbol> a(queries), b(queries);
+    for (int q = 0; q < queries; q++)
+    {
+        a[q] = names[next_random(seed) % names.size()];
+        b[q] = names[next_random(seed) % names.size()];
+    }
+
+    long conforming = 0, lca_conforming = 0;
+    double match_best = 0, lca_best = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        double start = now();
+        conforming = 0;
+        for (int q = 0; q < queries; q++)
+            conforming += match(a[q], b[q]);
+        double seconds = now() - start;
+        if (i == 0 || seconds < match_best)
+            match_best = seconds;
+
+        start = now();
+        lca_conforming = 0;
+        for (int q = 0; q < queries; q++)
+            lca_conforming += LCA(a[q], b[q]) == b[q];
+        seconds = now() - start;
+        if (i == 0 || seconds < lca_best)
+            lca_best = seconds;
+    }
+
+    printf("{\"shape\": \"%s\", \"classes\": %d, \"queries\": %d, \"conforming\": %ld, "
+           "\"match_seconds\": %.6f, \"lca_seconds\": %.6f}\n",
+           shape, classes, queries, conforming, match_best, lca_best);
+    if (conforming != lca_conforming)
+    {
+        fprintf(stderr, "matchbench: match() and LCA() disagree\n");
+        return 1;
+    }
+    return 0;
+}
@@ -3,7 +3,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "semant.h"
+#include "let-multi.h"
 #include "utilities.h"
 
 extern int semant_debug;
@@ -12,27 +20,82 @@ extern char *curr_filename;
 const int class_number_log = 20;
 int semant_errors = 0;
 ostream &error_stream = cerr;
-std::map<Symbol, Class_> class_table;
-std::map<Symbol, std::vector<method_class *>> method_table;
-std::map<Symbol, std::vector<Symbol>> adj;
-std::map<Symbol, bool> visit;
-std::map<Symbol, int> dis;
-std::map<Symbol, Symbol[class_number_log]> LCA_table;
-SymbolTable<Symbol, Symbol> id_type;
-Class_ curr_class;
+// per thread: see check_features()
+thread_local SymbolTable<Symbol, Symbol> id_type;
+thread_local Class_ curr_class;
+
+//
+// The installed classes, each with a dense ID given as it is installed:
+// the basic classes first, Object being 0, then the program's in order.
+// All that the checks need to know about a class is in its class_node,
+// so they index an array instead of looking the name up in a map, once
+// class_id() has turned the name into an ID.  class_order has the IDs in
+// the order of the Symbols of the names, the order classes are checked
+// and their errors reported in.
+//
+struct method_entry
+{
+    Symbol name;
+    method_class *method;
+    int defined_in;   // the ID of the class it is a feature of
+    int span;         // classes from this one up to defined_in
+    size_t signature; // signature_hash() of method
+    bool same_above;  // every method it overrides has its signature
+};
+
+struct attr_binding
+{
+    Symbol name;
+    Symbol type;
+};
+
+struct class_node
+{
+    Class_ c;
+    Symbol name;
+    std::vector<method_class *> methods; // each name once, in order
+    std::vector<attr_class *> attrs;     // in order, redefined ones too
+
+    // set by check_inheritance_graph()
+    std::vector<int> children;
+    bool visited; // reachable from Object
+    int depth;
+    int ancestors[class_number_log]; // the 2^i-th; Object if none
+    int tin, tout;                   // see match()
+
+    // set by index_methods(): every method of the class, its own and
+    // inherited, sorted by name, and the override errors on each method
+    // feature of the class, in order
+    std::vector<method_entry> method_index;
+    std::vector<int> override_errors;
+
+    // set by index_attrs(): see lookup_attr()
+    std::vector<attr_binding> attr_env;
+    int attr_parent;
+    int attr_redefined;
+};
+
+static const int object_id = 0;
+static std::vector<class_node> class_nodes;
+static std::unordered_map<Symbol, int> class_ids;
+static std::vector<int> class_order;
+static thread_local int curr_class_id; // of curr_class
 
 void install_basic_classes();
 void install_classes();
 void check_inheritance_graph();
-void make_LCA_table(Symbol, Symbol);
+int make_LCA_table(int, int);
 void install_methods();
+void index_methods();
+void index_attrs();
 void is_main_exists();
-Symbol get_par(Symbol, int);
+int get_par(int, int);
 Symbol LCA(Symbol, Symbol);
 bool match(Symbol, Symbol);
 ostream &semant_error();
 ostream &semant_error(Class_ c);
 ostream &semant_error(Symbol filename, tree_node *t);
+ostream &semant_error(Symbol filename, int line);
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -105,6 +168,36 @@ static void initialize_constants(void)
     val = idtable.add_string("_val");
 }
 
+// Gives c the next ID.
+static int add_class(Class_ c)
+{
+    int id = class_nodes.size();
+    class_nodes.push_back(class_node());
+    class_nodes[id].c = c;
+    class_nodes[id].name = c->get_name();
+    class_ids[c->get_name()] = id;
+    return id;
+}
+
+// The ID of the class named name; -1 if there is none.
+static int class_id(Symbol name)
+{
+    std::unordered_map<Symbol, int>::const_iterator i = class_ids.find(name);
+    return i == class_ids.end() ? -1 : i->second;
+}
+
+static bool is_class(Symbol name)
+{
+    return class_ids.count(name) != 0;
+}
+
+static void clear_classes()
+{
+    class_nodes.clear();
+    class_ids.clear();
+    class_order.clear();
+}
+
 void install_basic_classes()
 {
 
@@ -205,11 +298,27 @@ void install_basic_classes()
                                           Str,
                                           no_expr()))),
                filename);
-    class_table[Object_class->get_name()] = Object_class;
-    class_table[IO_class->get_name()] = IO_class;
-    class_table[Int_class->get_name()] = Int_class;
-    class_table[Bool_class->get_name()] = Bool_class;
-    class_table[Str_class->get_name()] = Str_class;
+    add_class(Object_class);
+    add_class(IO_class);
+    add_class(Int_class);
+    add_class(Bool_class);
+    add_class(Str_class);
+}
+
+// Enters one class into class_nodes; false if it cannot be, because it
+// is named SELF_TYPE or is already there.
+static bool install_class(Class_ curr)
+{
+    if (curr->get_name() == SELF_TYPE)
+    {
+        return false;
+    }
+    else if (is_class(curr->get_name()))
+    {
+        return false;
+    }
+    add_class(curr);
+    return true;
 }
 
 void install_classes(Classes classes)
@@ -217,63 +326,76 @@ void install_classes(Classes classes)
     for (int i = classes->first(); classes->more(i); i = classes->next(i))
     {
         Class_ curr = classes->nth(i);
-        Symbol par_name = curr->get_parent();
-        if (curr->get_name() == SELF_TYPE)
+        if (!install_class(curr))
         {
             semant_error(curr) << "error!\n";
         }
-        else if (class_table.count(curr->get_name()) > 0)
-        {
-            semant_error(curr) << "error!\n";
-        }
-        else
-        {
-            class_table[curr->get_name()] = curr;
-        }
     }
 }
 
 void check_inheritance_graph()
 {
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    class_order.clear();
+    for (size_t id = 0; id < class_nodes.size(); id++)
+        class_order.push_back(id);
+    std::sort(class_order.begin(), class_order.end(), [](int a, int b)
+              { return std::less<Symbol>()(class_nodes[a].name, class_nodes[b].name); });
+
+    for (size_t k = 0; k < class_order.size(); k++)
     {
-        if (iter->first != Object && class_table.count(iter->second->get_parent()) == 0)
+        class_node &node = class_nodes[class_order[k]];
+        if (node.name != Object && !is_class(node.c->get_parent()))
+        {
+            semant_error(node.c) << "error!\n";
+        }
+        else if (node.c->get_parent() == Bool || node.c->get_parent() == Str)
         {
-            semant_error(iter->second) << "error!\n";
+            semant_error(node.c) << "error!\n";
         }
-        else if (iter->second->get_parent() == Bool || iter->second->get_parent() == Str)
+    }
+    for (size_t k = 0; k < class_order.size(); k++)
+    {
+        class_node &node = class_nodes[class_order[k]];
+        node.children.clear();
+        node.visited = false;
+        node.depth = 0;
+        for (int i = 0; i < class_number_log; i++)
         {
-            semant_error(iter->second) << "error!\n";
+            node.ancestors[i] = object_id;
         }
     }
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    for (size_t k = 0; k < class_order.size(); k++)
     {
-        if (iter->first == Object)
+        int id = class_order[k];
+        if (id == object_id)
         {
             continue;
         }
-        if (class_table.count(iter->second->get_parent()) == 0 || iter->second->get_parent() == Bool || iter->second->get_parent() == Str)
+        Symbol parent = class_nodes[id].c->get_parent();
+        if (!is_class(parent) || parent == Bool || parent == Str)
         {
-            adj[Object].push_back(iter->first);
+            class_nodes[object_id].children.push_back(id);
         }
         else
         {
-            adj[iter->second->get_parent()].push_back(iter->first);
+            class_nodes[class_id(parent)].children.push_back(id);
         }
     }
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    int next_tin = make_LCA_table(object_id, object_id);
+    for (size_t k = 0; k < class_order.size(); k++)
     {
-        for (int i = 0; i < class_number_log; i++)
+        class_node &node = class_nodes[class_order[k]];
+        if (!node.visited)
         {
-            LCA_table[iter->first][i] = Object;
+            node.tin = node.tout = next_tin++;
         }
     }
-    make_LCA_table(Object, Object);
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    class_nodes[object_id].tout = next_tin - 1;
+    for (size_t k = 0; k < class_order.size(); k++)
     {
-        if (visit[iter->first] != true)
+        if (!class_nodes[class_order[k]].visited)
         {
-            semant_error(iter->second) << "error!\n";
+            semant_error(class_nodes[class_order[k]].c) << "error!\n";
         }
     }
 }
@@ -283,35 +405,80 @@ void check_inheritance_graph()
     However, using this algorithm is unnecessary, and you can use a loop to find LCA.
     The description of the algorithm I used can be found in the following link.
     https://cp-algorithms.com/graph/lca_binary_lifting.html
+
+    The walk is in preorder with a stack of its own rather than recursive,
+    so a deep hierarchy cannot overflow the C++ stack.  A class's depth is
+    one more than that of the parent it names, which for a class moved
+    under Object is not the depth of its parent in the tree.
+
+    The walk also numbers the classes in the order it enters them, for
+    match(): tin is a class's number and tout the last number in its
+    subtree.  Returns the next number.
 */
-void make_LCA_table(Symbol v, Symbol par)
+int make_LCA_table(int root, int root_par)
 {
-    visit[v] = true;
-    if (v != Object)
-    {
-        dis[v] = dis[class_table[v]->get_parent()] + 1;
-        LCA_table[v][0] = par;
-        for (int i = 1; i < class_number_log; i++)
+    std::vector<int> entered;
+    std::vector<std::pair<int, int>> stack(1, std::make_pair(root, root_par));
+    while (!stack.empty())
+    {
+        int v = stack.back().first, par = stack.back().second;
+        stack.pop_back();
+
+        class_node &node = class_nodes[v];
+        node.visited = true;
+        node.tin = node.tout = entered.size();
+        entered.push_back(v);
+        if (v != object_id)
         {
-            LCA_table[v][i] = LCA_table[LCA_table[v][i - 1]][i - 1];
+            int parent = class_id(node.c->get_parent());
+            node.depth = (parent < 0 ? 0 : class_nodes[parent].depth) + 1;
+            node.ancestors[0] = par;
+            for (int i = 1; i < class_number_log; i++)
+            {
+                node.ancestors[i] = class_nodes[node.ancestors[i - 1]].ancestors[i - 1];
+            }
         }
-    }
-    for (Symbol u : adj[v])
-    {
-        if (u != par)
+        for (size_t k = node.children.size(); k-- > 0;)
         {
-            make_LCA_table(u, v);
+            if (node.children[k] != par)
+            {
+                stack.push_back(std::make_pair(node.children[k], v));
+            }
         }
     }
+
+    for (size_t k = entered.size(); k-- > 1;)
+    {
+        class_node &parent = class_nodes[class_nodes[entered[k]].ancestors[0]];
+        parent.tout = std::max(parent.tout, class_nodes[entered[k]].tout);
+    }
+    return entered.size();
+}
+
+//
+// LCA() works on IDs.  A type that is not a class (one that is undefined,
+// or the NULL an earlier LCA() can give) becomes a negative node, of
+// depth 0 and with the NULL node, -1, as every ancestor.
+//
+static const int lca_null = -1, lca_v = -2, lca_u = -3;
+
+static int lca_ancestor(int v, int i)
+{
+    return v >= 0 ? class_nodes[v].ancestors[i] : lca_null;
+}
+
+static int lca_depth(int v)
+{
+    return v >= 0 ? class_nodes[v].depth : 0;
 }
 
-Symbol get_par(Symbol v, int p)
+int get_par(int v, int p)
 {
     for (int i = class_number_log - 1; i >= 0; i--)
     {
         if (p >> i & 1)
         {
-            v = LCA_table[v][i];
+            v = lca_ancestor(v, i);
         }
     }
     return v;
@@ -331,59 +498,353 @@ Symbol LCA(Symbol v, Symbol u)
     {
         u = curr_class->get_name();
     }
-    if (dis[v] < dis[u])
+    int a = class_id(v), b = class_id(u);
+    if (a < 0)
     {
-        Symbol temp = v;
-        v = u;
-        u = temp;
+        a = lca_v;
     }
-    v = get_par(v, dis[v] - dis[u]);
-    if (u == v)
+    if (b < 0)
     {
-        return v;
+        b = u == v ? lca_v : lca_u;
     }
-    for (int i = class_number_log - 1; i >= 0; i--)
+
+    if (lca_depth(a) < lca_depth(b))
     {
-        if (LCA_table[v][i] != LCA_table[u][i])
+        std::swap(a, b);
+    }
+    a = get_par(a, lca_depth(a) - lca_depth(b));
+    if (a != b)
+    {
+        for (int i = class_number_log - 1; i >= 0; i--)
         {
-            v = LCA_table[v][i];
-            u = LCA_table[u][i];
+            if (lca_ancestor(a, i) != lca_ancestor(b, i))
+            {
+                a = lca_ancestor(a, i);
+                b = lca_ancestor(b, i);
+            }
         }
+        a = lca_ancestor(a, 0);
+    }
+
+    if (a >= 0)
+    {
+        return class_nodes[a].name;
+    }
+    return a == lca_v ? v : a == lca_u ? u : NULL;
+}
+
+static bool method_entry_less(const method_entry &a, const method_entry &b)
+{
+    return std::less<Symbol>()(a.name, b.name);
+}
+
+static const method_entry *lookup_method(int id, Symbol name)
+{
+    const std::vector<method_entry> &index = class_nodes[id].method_index;
+    method_entry key = {name, NULL, -1, 0, 0, false};
+    std::vector<method_entry>::const_iterator i =
+        std::lower_bound(index.begin(), index.end(), key, method_entry_less);
+    return i != index.end() && i->name == name ? &*i : NULL;
+}
+
+// The method of class id or its nearest ancestor named name; NULL if none.
+static method_class *find_method(int id, Symbol name)
+{
+    if (id < 0)
+    {
+        return NULL;
     }
-    return LCA_table[v][0];
+    const method_entry *e = lookup_method(id, name);
+    return e != NULL ? e->method : NULL;
+}
+
+// A hash of a method's return and formal types, so that most methods
+// whose signatures differ are told apart without comparing them.
+static size_t signature_hash(method_class *m)
+{
+    size_t h = std::hash<Symbol>()(m->get_return_type());
+    Formals formals = m->get_formals();
+    for (int i = formals->first(); formals->more(i); i = formals->next(i))
+    {
+        h = h * 31 + std::hash<Symbol>()(formals->nth(i)->get_type());
+    }
+    return h;
+}
+
+static bool same_signature(method_class *m, size_t signature, const method_entry &e)
+{
+    if (signature != e.signature || m->get_return_type() != e.method->get_return_type())
+    {
+        return false;
+    }
+    Formals a = m->get_formals(), b = e.method->get_formals();
+    int i = a->first(), j = b->first();
+    for (; a->more(i) && b->more(j); i = a->next(i), j = b->next(j))
+    {
+        if (a->nth(i)->get_type() != b->nth(j)->get_type())
+        {
+            return false;
+        }
+    }
+    return !a->more(i) && !b->more(j);
+}
+
+// The errors on curr_method for overriding method: one if the return
+// types differ, one for each formal whose type differs, and one if
+// either has formals left when the other's run out (so none if either
+// has no formals).
+static int override_errors(method_class *curr_method, method_class *method)
+{
+    int errors = 0;
+    if (curr_method->get_return_type() != method->get_return_type())
+    {
+        errors++;
+    }
+    Formals curr_formals = curr_method->get_formals();
+    Formals formals = method->get_formals();
+
+    int cf = curr_formals->first(), f = formals->first();
+    while (curr_formals->more(cf) && formals->more(f))
+    {
+        if (curr_formals->nth(cf)->get_type() != formals->nth(f)->get_type())
+        {
+            errors++;
+        }
+        cf = curr_formals->next(cf);
+        f = formals->next(f);
+        if (curr_formals->more(cf) xor formals->more(f))
+        {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+// The override errors on method m of class id, whose index is built.  m
+// is checked against the method the class itself resolves its name to
+// (itself, unless m is defined twice) and then against what each of its
+// ancestors resolves the name to, one error set per ancestor: a method
+// inherited down span classes counts span times.  If the parent's method
+// and all it overrides have m's signature, there is nothing to count.
+static int class_override_errors(int id, method_class *m, size_t signature)
+{
+    int errors = override_errors(m, lookup_method(id, m->get_name())->method);
+    if (id == object_id)
+    {
+        return errors;
+    }
+
+    const method_entry *e = lookup_method(class_nodes[id].ancestors[0], m->get_name());
+    if (e != NULL && e->same_above && same_signature(m, signature, *e))
+    {
+        return errors;
+    }
+    while (e != NULL)
+    {
+        errors += e->span * override_errors(m, e->method);
+        if (e->defined_in == object_id)
+        {
+            break;
+        }
+        e = lookup_method(class_nodes[e->defined_in].ancestors[0], m->get_name());
+    }
+    return errors;
+}
+
+// Builds the method table and attribute list of one class; returns the
+// number of methods defined more than once in it, one error each.
+static int install_class_features(int id)
+{
+    class_node &node = class_nodes[id];
+    std::vector<method_class *> &methods = node.methods;
+    int redefined = 0;
+    Features features = node.c->get_features();
+    for (int i = features->first(); features->more(i); i = features->next(i))
+        if (features->nth(i)->is_method())
+        {
+            method_class *method = static_cast<method_class *>(features->nth(i));
+            bool redefined_flag = false;
+            for (size_t j = 0; j < methods.size(); j++)
+                if (methods[j]->get_name() == method->get_name())
+                    redefined_flag = true;
+
+            if (redefined_flag)
+                redefined++;
+            else
+                methods.push_back(method);
+        }
+        else
+            node.attrs.push_back(static_cast<attr_class *>(features->nth(i)));
+    return redefined;
 }
 
 void install_methods()
 {
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    for (size_t k = 0; k < class_order.size(); k++)
+    {
+        for (int n = install_class_features(class_order[k]); n > 0; n--)
+            semant_error(class_nodes[class_order[k]].c) << "error!\n";
+    }
+}
+
+// The IDs by tin.  Parents are numbered before their children, so each
+// class comes after its parent in the tree; a class not reachable from
+// Object comes after Object.
+static std::vector<int> classes_top_down()
+{
+    std::vector<int> by_tin(class_nodes.size());
+    for (size_t id = 0; id < class_nodes.size(); id++)
     {
-        Features features = iter->second->get_features();
+        by_tin[class_nodes[id].tin] = id;
+    }
+    return by_tin;
+}
+
+// Gives each class the method index find_method() looks in: its parent's
+// in the tree, with the class's own methods put in or over it.  Going top
+// down, the parent's index is always done first; a class not reachable
+// from Object starts from Object's.  With the index, the class's methods
+// are checked against those they override, for check_features() to
+// report.
+void index_methods()
+{
+    std::vector<int> by_tin = classes_top_down();
+    for (size_t k = 0; k < by_tin.size(); k++)
+    {
+        int id = by_tin[k];
+        class_node &node = class_nodes[id];
+        node.method_index.clear();
+        if (id != object_id)
+        {
+            node.method_index = class_nodes[node.ancestors[0]].method_index;
+            for (size_t i = 0; i < node.method_index.size(); i++)
+            {
+                node.method_index[i].span++;
+            }
+        }
+        for (size_t i = 0; i < node.methods.size(); i++)
+        {
+            method_class *method = node.methods[i];
+            method_entry e = {method->get_name(), method, id, 1, signature_hash(method), true};
+            std::vector<method_entry>::iterator at =
+                std::lower_bound(node.method_index.begin(), node.method_index.end(), e,
+                                 method_entry_less);
+            if (at != node.method_index.end() && at->name == e.name)
+            {
+                e.same_above = at->same_above && same_signature(method, e.signature, *at);
+                *at = e;
+            }
+            else
+            {
+                node.method_index.insert(at, e);
+            }
+        }
+
+        node.override_errors.clear();
+        Features features = node.c->get_features();
         for (int i = features->first(); features->more(i); i = features->next(i))
+        {
             if (features->nth(i)->is_method())
             {
                 method_class *method = static_cast<method_class *>(features->nth(i));
-                bool redefined_flag = false;
-                for (size_t j = 0; j < method_table[iter->first].size(); j++)
-                    if (method_table[iter->first][j]->get_name() == method->get_name())
-                        redefined_flag = true;
-
-                if (redefined_flag)
-                    semant_error(iter->second) << "error!\n";
-                else
-                    method_table[iter->first].push_back(method);
+                node.override_errors.push_back(
+                    class_override_errors(id, method, signature_hash(method)));
+            }
+        }
+    }
+}
+
+static bool attr_binding_less(const attr_binding &a, const attr_binding &b)
+{
+    return std::less<Symbol>()(a.name, b.name);
+}
+
+//
+// The attributes the methods of a class see are its own and those of its
+// ancestors below Object, the first definition of a name hiding any after
+// it, the class's before its parent's.  Each class keeps only the names
+// it adds, sorted (attr_env), and points to the nearest ancestor that
+// adds any (attr_parent), so an environment is built once and shared by
+// every class under it.  lookup_attr() gives the type of name in class
+// id's; NULL if it is not there.
+//
+static Symbol *lookup_attr(int id, Symbol name)
+{
+    attr_binding key = {name, NULL};
+    for (; id >= 0; id = class_nodes[id].attr_parent)
+    {
+        std::vector<attr_binding> &env = class_nodes[id].attr_env;
+        std::vector<attr_binding>::iterator i =
+            std::lower_bound(env.begin(), env.end(), key, attr_binding_less);
+        if (i != env.end() && i->name == name)
+        {
+            return &i->type;
+        }
+    }
+    return NULL;
+}
+
+// A name in the scopes of the method or attribute being checked, or else
+// an attribute of curr_class.
+static Symbol *lookup_id(Symbol name)
+{
+    Symbol *type = id_type.lookup(name);
+    return type != NULL ? type : lookup_attr(curr_class_id, name);
+}
+
+// Builds the environments of lookup_attr(), parents first.  Each
+// definition of a name that an earlier one in the class or its ancestors
+// hides is an error on the class and on every class under it:
+// attr_redefined counts them.
+void index_attrs()
+{
+    std::vector<int> by_tin = classes_top_down();
+    for (size_t k = 0; k < by_tin.size(); k++)
+    {
+        int id = by_tin[k];
+        class_node &node = class_nodes[id];
+        int parent = id == object_id ? -1 : node.ancestors[0];
+        if (parent == object_id)
+        {
+            parent = -1;
+        }
+
+        node.attr_env.clear();
+        node.attr_redefined = parent >= 0 ? class_nodes[parent].attr_redefined : 0;
+        for (size_t i = 0; i < node.attrs.size(); i++)
+        {
+            attr_binding b = {node.attrs[i]->get_name(), node.attrs[i]->get_type()};
+            std::vector<attr_binding>::iterator at =
+                std::lower_bound(node.attr_env.begin(), node.attr_env.end(), b, attr_binding_less);
+            if (at != node.attr_env.end() && at->name == b.name)
+            {
+                node.attr_redefined++;
+                continue;
+            }
+            node.attr_env.insert(at, b);
+            if (lookup_attr(parent, b.name) != NULL)
+            {
+                node.attr_redefined++;
             }
+        }
+        if (parent >= 0 && class_nodes[parent].attr_env.empty())
+        {
+            parent = class_nodes[parent].attr_parent;
+        }
+        node.attr_parent = parent;
     }
 }
 
 void is_main_exists()
 {
-    if (class_table.count(Main) == 0)
+    int main_id = class_id(Main);
+    if (main_id < 0)
     {
         semant_error() << "Class Main is not defined.\n";
         return;
     }
 
-    Features features = class_table[Main]->get_features();
+    Features features = class_nodes[main_id].c->get_features();
 
     bool main_flag = false;
     for (int i = features->first(); features->more(i); i = features->next(i))
@@ -391,7 +852,7 @@ void is_main_exists()
             main_flag = true;
 
     if (!main_flag)
-        semant_error(class_table[Main]) << "error!\n";
+        semant_error(class_nodes[main_id].c) << "error!\n";
 }
 
 bool match(Symbol T1, Symbol T2)
@@ -414,12 +875,17 @@ bool match(Symbol T1, Symbol T2)
         T1 = curr_class->get_name();
     }
 
-    if (LCA(T1, T2) == T2)
+    // T1 conforms to T2 if it is in T2's subtree, that is, if it was
+    // numbered between T2 and the last class under T2.  A class that is
+    // not reachable from Object is alone in its subtree, under Object's.
+    // As with LCA(), a type that is not a class conforms only to itself
+    // and to NULL, and no class conforms to one.
+    int a = class_id(T1), b = class_id(T2);
+    if (a < 0 || b < 0)
     {
-        return true;
+        return a < 0 && (T1 == T2 || T2 == NULL);
     }
-
-    return false;
+    return class_nodes[b].tin <= class_nodes[a].tin && class_nodes[a].tin <= class_nodes[b].tout;
 }
 
 Symbol object_class::inference_type()
@@ -428,9 +894,9 @@ Symbol object_class::inference_type()
     {
         type = SELF_TYPE;
     }
-    else if (id_type.lookup(name))
+    else if (lookup_id(name))
     {
-        type = *id_type.lookup(name);
+        type = *lookup_id(name);
     }
     else
     {
@@ -443,13 +909,13 @@ Symbol object_class::inference_type()
 Symbol assign_class::inference_type()
 {
     Symbol right_type = expr->inference_type();
-    if (id_type.lookup(name) == 0)
+    if (lookup_id(name) == 0)
     {
         semant_error(curr_class->get_filename(), this) << "error!\n";
         type = right_type;
         return type;
     }
-    Symbol left_type = *id_type.lookup(name);
+    Symbol left_type = *lookup_id(name);
     if (!match(right_type, left_type))
     {
         semant_error(curr_class->get_filename(), this) << "error\n";
@@ -481,7 +947,7 @@ Symbol string_const_class::inference_type()
 
 Symbol new__class::inference_type()
 {
-    if (this->type_name != SELF_TYPE && class_table.count(this->type_name) == 0)
+    if (this->type_name != SELF_TYPE && !is_class(this->type_name))
     {
         semant_error(curr_class->get_filename(), this) << "error!\n";
         this->type_name = Object;
@@ -621,7 +1087,7 @@ Symbol let_class::inference_type()
         id_type.addid(identifier, &type_decl);
 
         Symbol init_type = init->inference_type();
-        if (type_decl != SELF_TYPE && class_table.count(type_decl) == 0)
+        if (type_decl != SELF_TYPE && !is_class(type_decl))
         {
             semant_error(curr_class->get_filename(), this) << "error!\n";
         }
@@ -635,6 +1101,38 @@ Symbol let_class::inference_type()
     return type;
 }
 
+// The bindings of a let_multi are checked as let_class checks each let of
+// the nested chain, but in one scope: a later binding of the same name is
+// found first, as an inner let's would be.  Errors are on the line of the
+// binding, the line of its let in the chain.
+Symbol let_multi_class::inference_type()
+{
+    id_type.enterscope();
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        let_binding &b = bindings[i];
+        if (b.identifier == self)
+        {
+            semant_error(curr_class->get_filename(), b.line) << "error!\n";
+            continue;
+        }
+        id_type.addid(b.identifier, &b.type_decl);
+
+        Symbol init_type = b.init->inference_type();
+        if (b.type_decl != SELF_TYPE && !is_class(b.type_decl))
+        {
+            semant_error(curr_class->get_filename(), b.line) << "error!\n";
+        }
+        else if (!match(init_type, b.type_decl))
+        {
+            semant_error(curr_class->get_filename(), b.line) << "error!\n";
+        }
+    }
+    type = body->inference_type();
+    id_type.exitscope();
+    return type;
+}
+
 Symbol block_class::inference_type()
 {
     for (int i = body->first(); body->more(i); i = body->next(i))
@@ -711,33 +1209,12 @@ Symbol dispatch_class::inference_type()
 {
     Symbol expr_type = expr->inference_type();
 
-    method_class *method = NULL;
     Symbol curr = expr_type;
     if (curr == SELF_TYPE)
     {
         curr = curr_class->get_name();
     }
-    while (true)
-    {
-        std::vector<method_class *> methods = method_table[curr];
-        for (size_t i = 0; i < methods.size(); i++)
-        {
-            if (methods[i]->get_name() == name)
-            {
-                method = methods[i];
-                break;
-            }
-        }
-        if (method != NULL)
-        {
-            break;
-        }
-        if (curr == Object)
-        {
-            break;
-        }
-        curr = LCA_table[curr][0];
-    }
+    method_class *method = find_method(class_id(curr), name);
 
     if (method == NULL)
     {
@@ -792,14 +1269,14 @@ Symbol static_dispatch_class::inference_type()
 {
     Symbol expr_type = expr->inference_type();
 
-    if (this->type_name != SELF_TYPE && class_table.count(this->type_name) == 0)
+    if (this->type_name != SELF_TYPE && !is_class(this->type_name))
     {
         semant_error(curr_class->get_filename(), this) << "error!\n";
         type = Object;
         return type;
     }
 
-    if (expr_type != SELF_TYPE && class_table.count(expr_type) == 0)
+    if (expr_type != SELF_TYPE && !is_class(expr_type))
     {
         type = Object;
         return type;
@@ -812,29 +1289,7 @@ Symbol static_dispatch_class::inference_type()
         semant_error(curr_class->get_filename(), this) << "error!\n";
     }
 
-    method_class *method = NULL;
-    Symbol curr = type_name;
-    while (true)
-    {
-        std::vector<method_class *> methods = method_table[curr];
-        for (size_t i = 0; i < methods.size(); i++)
-        {
-            if (methods[i]->get_name() == name)
-            {
-                method = methods[i];
-                break;
-            }
-        }
-        if (method != NULL)
-        {
-            break;
-        }
-        if (curr == Object)
-        {
-            break;
-        }
-        curr = LCA_table[curr][0];
-    }
+    method_class *method = find_method(class_id(type_name), name);
 
     if (method == NULL)
     {
@@ -904,7 +1359,7 @@ void method_class::inference_type()
         {
             semant_error(curr_class->get_filename(), this) << "error!\n";
         }
-        else if (class_table.find(formals->nth(i)->get_type()) == class_table.end())
+        else if (!is_class(formals->nth(i)->get_type()))
         {
             semant_error(curr_class->get_filename(), this) << "error!\n";
         }
@@ -914,7 +1369,7 @@ void method_class::inference_type()
         }
     }
     Symbol expr_type = expr->inference_type();
-    if (return_type != SELF_TYPE && class_table.count(return_type) == 0)
+    if (return_type != SELF_TYPE && !is_class(return_type))
     {
         semant_error(curr_class->get_filename(), this) << "error!\n";
     }
@@ -925,128 +1380,182 @@ void method_class::inference_type()
     id_type.exitscope();
 }
 
+//
+// Once the hierarchy and the tables above are built they are only read,
+// so the features of the classes are checked in parallel, each method
+// body or attribute initializer a task of its own.  curr_class,
+// curr_class_id and id_type are per thread, and set for each task; a
+// task's errors go to the task (see semant_error()), not error_stream.
+// check_features() reports them task by task, in the order the features
+// are checked one at a time, so the output is the same byte for byte.
+//
+// COOL_SEMANT_THREADS in the environment sets the number of threads; by
+// default there is one per core.
+//
+struct feature_task
+{
+    int class_id;
+    Feature feature;
+    int override_errors; // of a method
+    std::ostringstream errors;
+    int error_count;
+};
+
+static thread_local feature_task *curr_task = NULL;
+
+static void check_feature(feature_task &task)
+{
+    curr_task = &task;
+    curr_class_id = task.class_id;
+    curr_class = class_nodes[task.class_id].c;
+    if (task.feature->is_method())
+    {
+        method_class *curr_method = static_cast<method_class *>(task.feature);
+        curr_method->inference_type();
+
+        for (int n = task.override_errors; n > 0; n--)
+        {
+            semant_error(curr_class->get_filename(), curr_method) << "error!\n";
+        }
+    }
+    else
+    {
+        attr_class *curr_attr = static_cast<attr_class *>(task.feature);
+        Symbol expr_type = curr_attr->get_expr()->inference_type();
+
+        if (is_class(expr_type) && !match(expr_type, curr_attr->get_type()))
+        {
+            semant_error(curr_class->get_filename(), curr_attr) << "error!\n";
+        }
+        if (curr_attr->get_name() == self)
+        {
+            semant_error(curr_class->get_filename(), curr_attr) << "error!\n";
+        }
+    }
+    curr_task = NULL;
+}
+
+static int semant_threads()
+{
+    const char *threads = getenv("COOL_SEMANT_THREADS");
+    int n = threads != NULL ? atoi(threads) : (int)std::thread::hardware_concurrency();
+    return n < 1 ? 1 : n;
+}
+
+// A thread's share of the tasks: it takes them from the front, and a
+// thread that has run out steals the back half of another's.
+struct task_range
+{
+    std::mutex mutex;
+    size_t next, end;
+};
+
+static bool steal_tasks(std::vector<task_range> &ranges, size_t thief)
+{
+    for (size_t k = 1; k < ranges.size(); k++)
+    {
+        task_range &victim = ranges[(thief + k) % ranges.size()];
+        size_t first, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.next >= victim.end)
+                continue;
+            first = victim.next + (victim.end - victim.next) / 2;
+            end = victim.end;
+            victim.end = first;
+        }
+        std::lock_guard<std::mutex> lock(ranges[thief].mutex);
+        ranges[thief].next = first;
+        ranges[thief].end = end;
+        return true;
+    }
+    return false;
+}
+
+static void check_tasks(std::vector<feature_task> &tasks, std::vector<task_range> &ranges,
+                        size_t self)
+{
+    for (;;)
+    {
+        size_t i;
+        {
+            std::lock_guard<std::mutex> lock(ranges[self].mutex);
+            i = ranges[self].next < ranges[self].end ? ranges[self].next++ : tasks.size();
+        }
+        if (i < tasks.size())
+            check_feature(tasks[i]);
+        else if (!steal_tasks(ranges, self))
+            return;
+    }
+}
+
 static void check_features()
 {
-    for (std::map<Symbol, Class_>::iterator iter = class_table.begin(); iter != class_table.end(); iter++)
+    std::vector<int> checked; // the classes, in order
+    size_t count = 0;
+    for (size_t k = 0; k < class_order.size(); k++)
     {
-        if (iter->first == Object || iter->first == IO || iter->first == Int || iter->first == Bool || iter->first == Str)
+        int id = class_order[k];
+        Symbol name = class_nodes[id].name;
+        if (name == Object || name == IO || name == Int || name == Bool || name == Str)
         {
             continue;
         }
+        checked.push_back(id);
+        count += class_nodes[id].c->get_features()->len();
+    }
 
-        curr_class = iter->second;
-
-        Symbol curr = curr_class->get_name();
-        while (curr != Object)
+    std::vector<feature_task> tasks(count);
+    size_t t = 0;
+    for (size_t k = 0; k < checked.size(); k++)
+    {
+        Features features = class_nodes[checked[k]].c->get_features();
+        size_t m = 0;
+        for (int i = features->first(); features->more(i); i = features->next(i), t++)
         {
-            Features features = class_table[curr]->get_features();
-            id_type.enterscope();
-            for (int i = features->first(); features->more(i); i = features->next(i))
-            {
-                if (features->nth(i)->is_method())
-                {
-                    continue;
-                }
-                attr_class *attr = static_cast<attr_class *>(features->nth(i));
-                if (id_type.lookup(attr->get_name()))
-                {
-                    semant_error(curr_class) << "error!\n";
-                    continue;
-                }
-
-                id_type.addid(attr->get_name(), new Symbol(attr->get_type()));
-            }
-            curr = LCA_table[curr][0];
+            tasks[t].class_id = checked[k];
+            tasks[t].feature = features->nth(i);
+            tasks[t].override_errors =
+                features->nth(i)->is_method() ? class_nodes[checked[k]].override_errors[m++] : 0;
+            tasks[t].error_count = 0;
         }
+    }
 
-        Features features = curr_class->get_features();
-        for (int i = features->first(); features->more(i); i = features->next(i))
+    size_t threads = std::min((size_t)semant_threads(), tasks.size());
+    if (threads <= 1)
+    {
+        for (t = 0; t < tasks.size(); t++)
+            check_feature(tasks[t]);
+    }
+    else
+    {
+        std::vector<task_range> ranges(threads);
+        for (size_t i = 0; i < threads; i++)
         {
-            if (features->nth(i)->is_method())
-            {
-                method_class *curr_method = static_cast<method_class *>(features->nth(i));
-                curr_method->inference_type();
-
-                method_class *method = NULL;
-                Symbol curr = curr_class->get_name();
-                while (true)
-                {
-                    method_class *method = NULL;
-                    Symbol temp = curr;
-                    while (true)
-                    {
-                        std::vector<method_class *> methods = method_table[temp];
-                        for (size_t j = 0; j < methods.size(); j++)
-                        {
-                            if (methods[j]->get_name() == curr_method->get_name())
-                            {
-                                method = methods[j];
-                                break;
-                            }
-                        }
-                        if (method != NULL)
-                        {
-                            break;
-                        }
-                        if (temp == Object)
-                        {
-                            break;
-                        }
-                        temp = LCA_table[temp][0];
-                    }
-                    if (method == NULL)
-                    {
-                        break;
-                    }
-                    if (curr_method->get_return_type() != method->get_return_type())
-                    {
-                        semant_error(curr_class->get_filename(), curr_method) << "error!\n";
-                    }
-                    Formals curr_formals = curr_method->get_formals();
-                    Formals formals = method->get_formals();
-
-                    int cf = curr_formals->first(), f = formals->first();
-                    while (curr_formals->more(cf) && formals->more(f))
-                    {
-                        if (curr_formals->nth(cf)->get_type() != formals->nth(f)->get_type())
-                        {
-                            semant_error(curr_class->get_filename(), curr_method) << "error!\n";
-                        }
-                        cf = curr_formals->next(cf);
-                        f = formals->next(f);
-                        if (curr_formals->more(cf) xor formals->more(f))
-                        {
-                            semant_error(curr_class->get_filename(), curr_method) << "error!\n";
-                        }
-                    }
-                    if (curr == Object)
-                    {
-                        break;
-                    }
-                    curr = LCA_table[curr][0];
-                }
-            }
-            else
-            {
-                attr_class *curr_attr = static_cast<attr_class *>(features->nth(i));
-                Symbol expr_type = curr_attr->get_expr()->inference_type();
-
-                if (class_table.count(expr_type) != 0 && !match(expr_type, curr_attr->get_type()))
-                {
-                    semant_error(curr_class->get_filename(), curr_attr) << "error!\n";
-                }
-                if (curr_attr->get_name() == self)
-                {
-                    semant_error(curr_class->get_filename(), curr_attr) << "error!\n";
-                }
-            }
+            ranges[i].next = tasks.size() * i / threads;
+            ranges[i].end = tasks.size() * (i + 1) / threads;
         }
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threads; i++)
+            workers.push_back(std::thread(check_tasks, std::ref(tasks), std::ref(ranges), i));
+        check_tasks(tasks, ranges, 0);
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
 
-        curr = curr_class->get_name();
-        while (curr != Object)
+    t = 0;
+    for (size_t k = 0; k < checked.size(); k++)
+    {
+        curr_class = class_nodes[checked[k]].c;
+        curr_class_id = checked[k];
+        for (int n = class_nodes[checked[k]].attr_redefined; n > 0; n--)
         {
-            id_type.exitscope();
-            curr = LCA_table[curr][0];
+            semant_error(curr_class) << "error!\n";
+        }
+        for (int i = curr_class->get_features()->len(); i > 0; i--, t++)
+        {
+            error_stream << tasks[t].errors.str();
+            semant_errors += tasks[t].error_count;
         }
     }
 }
@@ -1054,7 +1563,7 @@ static void check_features()
 ////////////////////////////////////////////////////////////////////
 //
 // semant_error is an overloaded function for reporting errors
-// during semantic analysis.  There are three versions:
+// during semantic analysis.  There are four versions:
 //
 //    ostream& ClassTable::semant_error()
 //
@@ -1064,6 +1573,12 @@ static void check_features()
 //    ostream& ClassTable::semant_error(Symbol filename, tree_node *t)
 //       print a line number and filename
 //
+//    ostream& ClassTable::semant_error(Symbol filename, int line)
+//       print the given line number and filename
+//
+// While a feature is checked they write to its task (see
+// check_features()) instead of error_stream.
+//
 ///////////////////////////////////////////////////////////////////
 
 ostream &semant_error(Class_ c)
@@ -1073,12 +1588,23 @@ ostream &semant_error(Class_ c)
 
 ostream &semant_error(Symbol filename, tree_node *t)
 {
-    error_stream << filename << ":" << t->get_line_number() << ": ";
-    return semant_error();
+    return semant_error(filename, t->get_line_number());
+}
+
+ostream &semant_error(Symbol filename, int line)
+{
+    ostream &stream = semant_error();
+    stream << filename << ":" << line << ": ";
+    return stream;
 }
 
 ostream &semant_error()
 {
+    if (curr_task != NULL)
+    {
+        curr_task->error_count++;
+        return curr_task->errors;
+    }
     semant_errors++;
     return error_stream;
 }
@@ -1087,6 +1613,126 @@ int errors()
 {
     return semant_errors;
 }
+
+////////////////////////////////////////////////////////////////////
+//
+// Streaming (semant.h)
+//
+// The consumer thread runs install_class() and install_class_features()
+// on each class as it comes off the queue.  Nothing else touches
+// class_nodes or class_ids until program_class::semant() has joined it.
+// Its errors are kept, as the classes they are reported on, and reported
+// by semant() where install_classes() and install_methods() would have
+// reported them.
+//
+////////////////////////////////////////////////////////////////////
+
+static struct
+{
+    bool active;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Class_> queue;
+    bool done;
+    std::thread consumer;
+
+    // the consumer's, until it is joined
+    std::vector<Class_> classes;        // every class taken, in order
+    std::vector<Class_> install_errors; // an error each
+    std::vector<int> redefined;         // methods defined twice, by ID
+} class_stream;
+
+static void consume_classes()
+{
+    std::deque<Class_> taken;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(class_stream.mutex);
+            class_stream.changed.wait(lock, []()
+                                      { return class_stream.done || !class_stream.queue.empty(); });
+            if (class_stream.queue.empty())
+                return;
+            taken.swap(class_stream.queue);
+        }
+        for (size_t i = 0; i < taken.size(); i++)
+        {
+            Class_ c = taken[i];
+            class_stream.classes.push_back(c);
+            if (!install_class(c))
+                class_stream.install_errors.push_back(c);
+            else
+            {
+                int id = class_nodes.size() - 1;
+                class_stream.redefined.resize(id + 1);
+                class_stream.redefined[id] = install_class_features(id);
+            }
+        }
+        taken.clear();
+    }
+}
+
+void semant_stream_begin()
+{
+    initialize_constants();
+    install_basic_classes();
+    for (size_t id = 0; id < class_nodes.size(); id++)
+        install_class_features(id);
+
+    class_stream.classes.clear();
+    class_stream.install_errors.clear();
+    class_stream.redefined.clear();
+    class_stream.active = true;
+    class_stream.done = false;
+    class_stream.consumer = std::thread(consume_classes);
+}
+
+void semant_stream_class(Class_ c)
+{
+    {
+        std::lock_guard<std::mutex> lock(class_stream.mutex);
+        class_stream.queue.push_back(c);
+    }
+    class_stream.changed.notify_one();
+}
+
+static void join_class_stream()
+{
+    {
+        std::lock_guard<std::mutex> lock(class_stream.mutex);
+        class_stream.done = true;
+    }
+    class_stream.changed.notify_one();
+    class_stream.consumer.join();
+    class_stream.active = false;
+}
+
+void semant_stream_cancel()
+{
+    if (!class_stream.active)
+        return;
+    join_class_stream();
+    clear_classes();
+}
+
+// Waits for the consumer to finish.  True if it took exactly the classes
+// of the program, in order; if not, what it did is thrown away and the
+// classes are installed again from the start.
+static bool finish_class_stream(Classes classes)
+{
+    if (!class_stream.active)
+        return false;
+    join_class_stream();
+
+    bool same = (int)class_stream.classes.size() == classes->len();
+    for (int i = classes->first(); same && classes->more(i); i = classes->next(i))
+        same = class_stream.classes[i] == classes->nth(i);
+    if (!same)
+    {
+        clear_classes();
+    }
+    return same;
+}
 /*   This is the entry point to the semantic checker.
 
      Your checker should do the following two things:
@@ -1102,16 +1748,34 @@ int errors()
  */
 void program_class::semant()
 {
+    ast_arena_phase("semant");
+    // the stream's consumer reads the constants until it is joined
+    bool streamed = finish_class_stream(classes);
     initialize_constants();
 
     /* ClassTable constructor may do some semantic analysis */
 
     /* some semantic analysis code may go here */
 
-    install_basic_classes();
-    install_classes(classes);
-    check_inheritance_graph();
-    install_methods();
+    if (streamed)
+    {
+        for (size_t i = 0; i < class_stream.install_errors.size(); i++)
+            semant_error(class_stream.install_errors[i]) << "error!\n";
+        check_inheritance_graph();
+        class_stream.redefined.resize(class_nodes.size());
+        for (size_t k = 0; k < class_order.size(); k++)
+            for (int n = class_stream.redefined[class_order[k]]; n > 0; n--)
+                semant_error(class_nodes[class_order[k]].c) << "error!\n";
+    }
+    else
+    {
+        install_basic_classes();
+        install_classes(classes);
+        check_inheritance_graph();
+        install_methods();
+    }
+    index_methods();
+    index_attrs();
     is_main_exists();
     check_features();
 
@@ -15,4 +15,30 @@
 #define TRUE 1
 #define FALSE 0
 
+//
+// Semantic analysis that starts while the program is still being parsed.
+// semant_stream_begin() installs the basic classes and starts a thread;
+// each class given to semant_stream_class() is queued for it, to be
+// entered into the class table and have its method table built.  The
+// parser hands over each class as it reduces it (on_class in
+// parse-context.h):
+//
+//     semant_stream_begin();
+//     ctx.on_class = semant_stream_class;
+//     if (cool_parse(&ctx) == 0 && omerrs == 0)
+//         ctx.ast_root->semant();
+//     else
+//         semant_stream_cancel();
+//
+// program_class::semant() waits for the queue to drain and goes on with
+// the checks that need the whole hierarchy.  The errors are the same, and
+// in the same order, as without streaming.  If the classes streamed are
+// not those of the program, in order, semant() installs them again.
+// semant_stream_begin() interns symbols, so it must not run while a
+// scanner does.
+//
+void semant_stream_begin();
+void semant_stream_class(Class_ c);
+void semant_stream_cancel();
+
 #endif